@@ -100,12 +100,12 @@ bool ClapSawDemo::guiSetParent(const clap_window *window) noexcept
     else
     {
         // Pull the parameters on the main thread
-        for (const auto &[k, v] : paramToValue)
+        for (int i = 0; i < nParams; ++i)
         {
             auto r = ToUI();
             r.type = ToUI::PARAM_VALUE;
-            r.id = k;
-            r.value = *v;
+            r.id = paramDescs[i].id;
+            r.value = paramValues[i];
             toUiQ.try_enqueue(r);
         }
     }
@@ -365,27 +365,38 @@ ftxui::Component ClapSawDemoEditor::onCreateComponent()
     createParameterComponents();
 
     // Create main container with tab navigation
-    tab_entries_ = {"Oscillator", "Filter", "Amplifier"};
+    tab_entries_ = {"Oscillator", "Filter", "Amplifier", "Engine"};
     auto tabs = ftxui::Menu(&tab_entries_, &selected_tab_);
 
     // Create section containers that hold actual components
     auto oscillator_container =
         ftxui::Container::Vertical({param_components_[ClapSawDemo::pmUnisonCount],
                                     param_components_[ClapSawDemo::pmUnisonSpread],
-                                    param_components_[ClapSawDemo::pmOscDetune]});
+                                    param_components_[ClapSawDemo::pmOscDetune],
+                                    param_components_[ClapSawDemo::pmBendRange],
+                                    param_components_[ClapSawDemo::pmOscEngine]});
 
     auto filter_container = ftxui::Container::Vertical(
         {param_components_[ClapSawDemo::pmPreFilterVCA], param_components_[ClapSawDemo::pmCutoff],
          param_components_[ClapSawDemo::pmResonance],
-         param_components_[ClapSawDemo::pmFilterMode]});
+         param_components_[ClapSawDemo::pmFilterMode],
+         param_components_[ClapSawDemo::pmFilterGlide]});
 
     auto amplifier_container = ftxui::Container::Vertical(
         {param_components_[ClapSawDemo::pmAmpAttack], param_components_[ClapSawDemo::pmAmpRelease],
-         param_components_[ClapSawDemo::pmAmpIsGate]});
+         param_components_[ClapSawDemo::pmAmpIsGate], param_components_[ClapSawDemo::pmAmpCurve]});
+
+    auto engine_container =
+        ftxui::Container::Vertical({param_components_[ClapSawDemo::pmVoiceEngine],
+                                    param_components_[ClapSawDemo::pmStealPolicy],
+                                    param_components_[ClapSawDemo::pmMaxPolyphony],
+                                    param_components_[ClapSawDemo::pmInternalThreads],
+                                    param_components_[ClapSawDemo::pmOversampling]});
 
     // Create main content area that shows the right section
     auto content = ftxui::Container::Tab(
-        {oscillator_container, filter_container, amplifier_container}, &selected_tab_);
+        {oscillator_container, filter_container, amplifier_container, engine_container},
+        &selected_tab_);
 
     // Wrap with renderer to add section styling
     auto styled_content = ftxui::Renderer(content,
@@ -401,6 +412,8 @@ ftxui::Component ClapSawDemoEditor::onCreateComponent()
                                                   return renderFilterSection();
                                               case 2:
                                                   return renderAmplifierSection();
+                                              case 3:
+                                                  return renderEngineSection();
                                               default:
                                                   return renderOscillatorSection();
                                               }
@@ -450,6 +463,15 @@ void ClapSawDemoEditor::createParameterComponents()
         createSliderForParam(ClapSawDemo::pmUnisonSpread, "Spread (cents)", 0, 100);
     param_components_[ClapSawDemo::pmOscDetune] =
         createSliderForParam(ClapSawDemo::pmOscDetune, "Detune (cents)", -200, 200);
+    param_components_[ClapSawDemo::pmBendRange] =
+        createSliderForParam(ClapSawDemo::pmBendRange, "Bend Range", 0, 24);
+
+    std::vector<std::pair<int, std::string>> osc_engines = {
+        {SawDemoVoice::OSC_DPW, "DPW"},
+        {SawDemoVoice::OSC_WAVETABLE_LINEAR, "Wavetable (Linear)"},
+        {SawDemoVoice::OSC_WAVETABLE_CUBIC, "Wavetable (Cubic)"}};
+    param_components_[ClapSawDemo::pmOscEngine] =
+        createRadioButtonForParam(ClapSawDemo::pmOscEngine, osc_engines);
 
     // Create filter components
     param_components_[ClapSawDemo::pmPreFilterVCA] =
@@ -466,6 +488,11 @@ void ClapSawDemoEditor::createParameterComponents()
     param_components_[ClapSawDemo::pmFilterMode] =
         createRadioButtonForParam(ClapSawDemo::pmFilterMode, filter_modes);
 
+    std::vector<std::pair<int, std::string>> filter_glides = {
+        {0, "Off"}, {1, "8 Samples"}, {2, "16 Samples"}, {3, "32 Samples"}};
+    param_components_[ClapSawDemo::pmFilterGlide] =
+        createRadioButtonForParam(ClapSawDemo::pmFilterGlide, filter_glides);
+
     // Create amplifier components
     param_components_[ClapSawDemo::pmAmpAttack] =
         createSliderForParam(ClapSawDemo::pmAmpAttack, "Attack (s)", 0.0f, 1.0f);
@@ -473,6 +500,32 @@ void ClapSawDemoEditor::createParameterComponents()
         createSliderForParam(ClapSawDemo::pmAmpRelease, "Release (s)", 0.0f, 1.0f);
     param_components_[ClapSawDemo::pmAmpIsGate] =
         createSwitchForParam(ClapSawDemo::pmAmpIsGate, "Deactivate Envelope", false);
+
+    std::vector<std::pair<int, std::string>> amp_curves = {
+        {SawDemoVoice::AEG_LINEAR, "Linear"}, {SawDemoVoice::AEG_EXPONENTIAL, "Exponential"}};
+    param_components_[ClapSawDemo::pmAmpCurve] =
+        createRadioButtonForParam(ClapSawDemo::pmAmpCurve, amp_curves);
+
+    // Create engine components
+    std::vector<std::pair<int, std::string>> voice_engines = {
+        {ClapSawDemo::PER_VOICE, "Per Voice"}, {ClapSawDemo::VOICE_PARALLEL, "Voice Parallel"}};
+    param_components_[ClapSawDemo::pmVoiceEngine] =
+        createRadioButtonForParam(ClapSawDemo::pmVoiceEngine, voice_engines);
+
+    using Allocator = VoiceAllocator<ClapSawDemo::max_voices>;
+    std::vector<std::pair<int, std::string>> steal_policies = {
+        {Allocator::RELEASED_FIRST, "Released First"}, {Allocator::OLDEST, "Oldest"}};
+    param_components_[ClapSawDemo::pmStealPolicy] =
+        createRadioButtonForParam(ClapSawDemo::pmStealPolicy, steal_policies);
+    param_components_[ClapSawDemo::pmMaxPolyphony] = createSliderForParam(
+        ClapSawDemo::pmMaxPolyphony, "Max Polyphony", 1, ClapSawDemo::max_voices);
+    param_components_[ClapSawDemo::pmInternalThreads] =
+        createSwitchForParam(ClapSawDemo::pmInternalThreads, "Internal Threads", false);
+
+    std::vector<std::pair<int, std::string>> oversampling_factors = {
+        {0, "Off"}, {1, "2x"}, {2, "4x"}};
+    param_components_[ClapSawDemo::pmOversampling] =
+        createRadioButtonForParam(ClapSawDemo::pmOversampling, oversampling_factors);
 }
 
 // Section renderer implementations
@@ -505,7 +558,17 @@ ftxui::Element ClapSawDemoEditor::renderOscillatorSection()
                              " cents"),
                          ftxui::text("Current: " +
                                      std::to_string((int)paramCopy[ClapSawDemo::pmOscDetune]))}) |
-                    ftxui::flex}),
+                        ftxui::flex,
+                    ftxui::separator(),
+                    ftxui::vbox({ftxui::text("Oscillator Engine:"),
+                                 ftxui::text(
+                                     "Mode: " +
+                                     std::to_string((int)paramCopy[ClapSawDemo::pmOscEngine])),
+                                 ftxui::text(
+                                     "Bend Range: " +
+                                     std::to_string((int)paramCopy[ClapSawDemo::pmBendRange]) +
+                                     " semitones")}) |
+                        ftxui::flex}),
                ftxui::text("") // spacing
            }) |
            ftxui::border | ftxui::size(ftxui::HEIGHT, ftxui::GREATER_THAN, 12);
@@ -550,7 +613,10 @@ ftxui::Element ClapSawDemoEditor::renderFilterSection()
                     ftxui::vbox(
                         {ftxui::text("Filter Type:"),
                          ftxui::text("Mode: " +
-                                     std::to_string((int)paramCopy[ClapSawDemo::pmFilterMode]))}) |
+                                     std::to_string((int)paramCopy[ClapSawDemo::pmFilterMode])),
+                         ftxui::text("Smoothing: " +
+                                     std::string(ClapSawDemo::filterGlideNames[std::clamp(
+                                         (int)paramCopy[ClapSawDemo::pmFilterGlide], 0, 3)]))}) |
                         ftxui::flex}),
                ftxui::text("") // spacing
            }) |
@@ -592,11 +658,56 @@ ftxui::Element ClapSawDemoEditor::renderAmplifierSection()
                                  ftxui::text("Envelope: " +
                                              std::string(paramCopy[ClapSawDemo::pmAmpIsGate] > 0.5f
                                                              ? "Disabled"
-                                                             : "Enabled"))}) |
+                                                             : "Enabled")),
+                                 ftxui::text("Shape: " +
+                                             std::string(ClapSawDemo::ampCurveNames[std::clamp(
+                                                 (int)paramCopy[ClapSawDemo::pmAmpCurve], 0,
+                                                 1)]))}) |
                     ftxui::flex}),
                ftxui::text("") // spacing
            }) |
            ftxui::border | ftxui::size(ftxui::HEIGHT, ftxui::GREATER_THAN, 12);
 }
 
+ftxui::Element ClapSawDemoEditor::renderEngineSection()
+{
+    // Create layout with parameter value displays
+    return ftxui::vbox({
+               ftxui::text("ENGINE") | ftxui::bold | ftxui::center, ftxui::separator(),
+               ftxui::hbox({ftxui::vbox({ftxui::text("Voice Engine:"),
+                                         ftxui::text(paramCopy[ClapSawDemo::pmVoiceEngine] > 0.5f
+                                                         ? "Voice Parallel"
+                                                         : "Per Voice")}) |
+                                ftxui::flex,
+                            ftxui::separator(),
+                            ftxui::vbox({ftxui::text("Voice Stealing:"),
+                                         ftxui::text(paramCopy[ClapSawDemo::pmStealPolicy] > 0.5f
+                                                         ? "Oldest"
+                                                         : "Released First"),
+                                         ftxui::text("Stolen: " +
+                                                     std::to_string(synthData.voicesStolen))}) |
+                                ftxui::flex}),
+               ftxui::separator(),
+               ftxui::hbox(
+                   {ftxui::vbox({ftxui::text("Max Polyphony: " +
+                                             std::to_string(
+                                                 (int)paramCopy[ClapSawDemo::pmMaxPolyphony])),
+                                 ftxui::text("Applies when the host restarts the plugin")}) |
+                        ftxui::flex,
+                    ftxui::separator(),
+                    ftxui::vbox({ftxui::text("Internal Threads:"),
+                                 ftxui::text(paramCopy[ClapSawDemo::pmInternalThreads] > 0.5f
+                                                 ? "On"
+                                                 : "Off")}) |
+                        ftxui::flex,
+                    ftxui::separator(),
+                    ftxui::vbox({ftxui::text("Oversampling:"),
+                                 ftxui::text(ClapSawDemo::oversamplingNames[std::clamp(
+                                     (int)paramCopy[ClapSawDemo::pmOversampling], 0, 2)])}) |
+                        ftxui::flex}),
+               ftxui::text("") // spacing
+           }) |
+           ftxui::border | ftxui::size(ftxui::HEIGHT, ftxui::GREATER_THAN, 12);
+}
+
 } // namespace sst::clap_saw_demo
@@ -46,6 +46,7 @@ struct ClapSawDemoEditor : public ftxui_clap_editor
     ftxui::Element renderOscillatorSection();
     ftxui::Element renderAmplifierSection();
     ftxui::Element renderFilterSection();
+    ftxui::Element renderEngineSection();
     ftxui::Element renderFooter();
 
     // Parameter Queues
@@ -5,6 +5,7 @@
  */
 
 #include "clap-saw-demo.h"
+#include "denormals.h"
 #include <iostream>
 #include <cmath>
 #include <cstring>
@@ -25,16 +26,8 @@ ClapSawDemo::ClapSawDemo(const clap_host *host)
                             clap::helpers::CheckingLevel::Maximal>(&desc, host)
 {
     _DBGCOUT << "Constructing ClapSawDemo" << std::endl;
-    paramToValue[pmUnisonCount] = &unisonCount;
-    paramToValue[pmUnisonSpread] = &unisonSpread;
-    paramToValue[pmOscDetune] = &oscDetune;
-    paramToValue[pmAmpAttack] = &ampAttack;
-    paramToValue[pmAmpRelease] = &ampRelease;
-    paramToValue[pmAmpIsGate] = &ampIsGate;
-    paramToValue[pmCutoff] = &cutoff;
-    paramToValue[pmResonance] = &resonance;
-    paramToValue[pmPreFilterVCA] = &preFilterVCA;
-    paramToValue[pmFilterMode] = &filterMode;
+    for (int i = 0; i < nParams; ++i)
+        paramValues[i] = paramDescs[i].def;
 
     terminatedVoices.reserve(max_voices * 4);
 }
@@ -44,6 +37,9 @@ ClapSawDemo::~ClapSawDemo()
     // with an open window but
     if (editor)
         guiDestroy();
+
+    if (workerPool)
+        workerPool->unregisterJob(workerJob);
 }
 
 const char *features[] = {CLAP_PLUGIN_FEATURE_INSTRUMENT, CLAP_PLUGIN_FEATURE_SYNTHESIZER, nullptr};
@@ -66,116 +62,30 @@ bool ClapSawDemo::paramsInfo(uint32_t paramIndex, clap_param_info *info) const n
         return false;
 
     /*
-     * Our job is to populate the clap_param_info. We set each of our parameters as AUTOMATABLE
-     * and then begin setting per-parameter features.
+     * Our job is to populate the clap_param_info, which is just a copy of the row in
+     * paramDescs. The flags there say which params are automatable, stepped, and
+     * polyphonically modulatable.
      */
-    info->flags = CLAP_PARAM_IS_AUTOMATABLE;
-
-    /*
-     * These constants activate polyphonic modulatability on a parameter. Not all the params here
-     * support that
-     */
-    auto mod = CLAP_PARAM_IS_MODULATABLE | CLAP_PARAM_IS_MODULATABLE_PER_NOTE_ID |
-               CLAP_PARAM_IS_MODULATABLE_PER_KEY;
-
-    switch (paramIndex)
-    {
-    case 0:
-        info->id = pmUnisonCount;
-        strncpy(info->name, "Unison Count", CLAP_NAME_SIZE);
-        strncpy(info->module, "Oscillator", CLAP_NAME_SIZE);
-        info->min_value = 1;
-        info->max_value = SawDemoVoice::max_uni;
-        info->default_value = 3;
-        info->flags |= CLAP_PARAM_IS_STEPPED;
-        break;
-    case 1:
-        info->id = pmUnisonSpread;
-        strncpy(info->name, "Unison Spread in Cents", CLAP_NAME_SIZE);
-        strncpy(info->module, "Oscillator", CLAP_NAME_SIZE);
-        info->min_value = 0;
-        info->max_value = 100;
-        info->default_value = 10;
-        info->flags |= mod;
-        break;
-    case 2:
-        info->id = pmOscDetune;
-        strncpy(info->name, "Oscillator Detuning (in cents)", CLAP_NAME_SIZE);
-        strncpy(info->module, "Oscillator", CLAP_NAME_SIZE);
-        info->min_value = -200;
-        info->max_value = 200;
-        info->default_value = 0;
-        info->flags |= mod;
-        break;
-    case 3:
-        info->id = pmAmpAttack;
-        strncpy(info->name, "Amplitude Attack (s)", CLAP_NAME_SIZE);
-        strncpy(info->module, "Amplitude Envelope Generator", CLAP_NAME_SIZE);
-        info->min_value = 0;
-        info->max_value = 1;
-        info->default_value = 0.01;
-        break;
-    case 4:
-        info->id = pmAmpRelease;
-        strncpy(info->name, "Amplitude Release (s)", CLAP_NAME_SIZE);
-        strncpy(info->module, "Amplitude Envelope Generator", CLAP_NAME_SIZE);
-        info->min_value = 0;
-        info->max_value = 1;
-        info->default_value = 0.2;
-        break;
-    case 5:
-        info->id = pmAmpIsGate;
-        strncpy(info->name, "Deactivate Amp Envelope", CLAP_NAME_SIZE);
-        strncpy(info->module, "Amplitude Envelope Generator", CLAP_NAME_SIZE);
-        info->min_value = 0;
-        info->max_value = 1;
-        info->default_value = 0;
-        info->flags |= CLAP_PARAM_IS_STEPPED;
-        break;
-    case 6:
-        info->id = pmPreFilterVCA;
-        strncpy(info->name, "Pre Filter VCA", CLAP_NAME_SIZE);
-        strncpy(info->module, "Filter", CLAP_NAME_SIZE);
-        info->min_value = 0;
-        info->max_value = 1;
-        info->default_value = 1;
-        info->flags |= mod;
-        break;
-    case 7:
-        info->id = pmCutoff;
-        strncpy(info->name, "Cutoff in Keys", CLAP_NAME_SIZE);
-        strncpy(info->module, "Filter", CLAP_NAME_SIZE);
-        info->min_value = 1;
-        info->max_value = 127;
-        info->default_value = 69;
-        info->flags |= mod;
-        break;
-    case 8:
-        info->id = pmResonance;
-        strncpy(info->name, "Resonance", CLAP_NAME_SIZE);
-        strncpy(info->module, "Filter", CLAP_NAME_SIZE);
-        info->min_value = 0.0;
-        info->max_value = 1.0;
-        info->default_value = 0.7;
-        info->flags |= mod;
-        break;
-    case 9:
-        info->id = pmFilterMode;
-        strncpy(info->name, "Filter Type", CLAP_NAME_SIZE);
-        strncpy(info->module, "Filter", CLAP_NAME_SIZE);
-        info->min_value = SawDemoVoice::StereoSimperSVF::Mode::LP;
-        info->max_value = SawDemoVoice::StereoSimperSVF::Mode::ALL;
-        info->default_value = 0;
-        info->flags |= CLAP_PARAM_IS_STEPPED;
-        break;
-    }
+    const auto &d = paramDescs[paramIndex];
+    info->id = d.id;
+    strncpy(info->name, d.name, CLAP_NAME_SIZE);
+    strncpy(info->module, d.module, CLAP_NAME_SIZE);
+    info->min_value = d.min;
+    info->max_value = d.max;
+    info->default_value = d.def;
+    info->flags = d.flags;
+    info->cookie = nullptr;
     return true;
 }
 
 bool ClapSawDemo::paramsValueToText(clap_id paramId, double value, char *display,
                                     uint32_t size) noexcept
 {
-    auto pid = (paramIds)paramId;
+    auto idx = paramIndex(paramId);
+    if (idx < 0)
+        return false;
+
+    const auto &d = paramDescs[idx];
     std::string sValue{"ERROR"};
     auto n2s = [](auto n)
     {
@@ -183,59 +93,36 @@ bool ClapSawDemo::paramsValueToText(clap_id paramId, double value, char *display
         oss << std::setprecision(6) << n;
         return oss.str();
     };
-    switch (pid)
+    switch (d.display)
     {
-    case pmResonance:
-    case pmPreFilterVCA:
+    case ParamDesc::NUMBER:
         sValue = n2s(value);
         break;
-    case pmAmpRelease:
-    case pmAmpAttack:
+    case ParamDesc::SECONDS:
         sValue = n2s(scaleTimeParamToSeconds(value)) + " s";
         break;
-    case pmUnisonCount:
-    {
-        int vc = static_cast<int>(value);
-        sValue = n2s(vc) + (vc == 1 ? " voice" : " voices");
-        break;
-    }
-    case pmUnisonSpread:
-    case pmOscDetune:
+    case ParamDesc::CENTS:
         sValue = n2s(value) + " cents";
         break;
-    case pmAmpIsGate:
-        sValue = value > 0.5 ? "AEG Bypassed" : "AEG On";
+    case ParamDesc::SEMITONES:
+        sValue = n2s(value) + " semitones";
         break;
-    case pmCutoff:
+    case ParamDesc::HZ:
     {
         auto co = 440 * pow(2.0, (value - 69) / 12);
         sValue = n2s(co) + " Hz";
         break;
     }
-    case pmFilterMode:
+    case ParamDesc::VOICES:
     {
-        auto fm = (SawDemoVoice::StereoSimperSVF::Mode) static_cast<int>(value);
-        switch (fm)
-        {
-        case SawDemoVoice::StereoSimperSVF::LP:
-            sValue = "LowPass";
-            break;
-        case SawDemoVoice::StereoSimperSVF::BP:
-            sValue = "BandPass";
-            break;
-        case SawDemoVoice::StereoSimperSVF::HP:
-            sValue = "HighPass";
-            break;
-        case SawDemoVoice::StereoSimperSVF::NOTCH:
-            sValue = "Notch";
-            break;
-        case SawDemoVoice::StereoSimperSVF::PEAK:
-            sValue = "Peak";
-            break;
-        case SawDemoVoice::StereoSimperSVF::ALL:
-            sValue = "AllPass";
-            break;
-        }
+        int vc = static_cast<int>(value);
+        sValue = n2s(vc) + (vc == 1 ? " voice" : " voices");
+        break;
+    }
+    case ParamDesc::CHOICE:
+    {
+        auto c = std::clamp(static_cast<int>(std::round(value)), (int)d.min, (int)d.max);
+        sValue = d.choices[c - (int)d.min];
         break;
     }
     }
@@ -247,52 +134,49 @@ bool ClapSawDemo::paramsValueToText(clap_id paramId, double value, char *display
 
 bool ClapSawDemo::paramsTextToValue(clap_id paramId, const char *display, double *value) noexcept
 {
-    switch (paramId)
+    auto idx = paramIndex(paramId);
+    if (idx < 0)
+        return false;
+
+    const auto &d = paramDescs[idx];
+    double res{0};
+    switch (d.display)
     {
-    case pmResonance:
-    case pmPreFilterVCA:
-        *value = std::clamp(std::atof(display), 0., 1.);
-        return true;
+    case ParamDesc::NUMBER:
+    case ParamDesc::CENTS:
+    case ParamDesc::SEMITONES:
+        res = std::atof(display);
         break;
-    case pmAmpRelease:
-    case pmAmpAttack:
-        *value = scaleSecondsToTimeParam(std::atof(display));
-        return true;
+    case ParamDesc::SECONDS:
+        res = scaleSecondsToTimeParam(std::atof(display));
         break;
-    case pmUnisonCount:
-    {
-        *value = std::clamp(std::atoi(display), 1, 7);
-        return true;
-        break;
-    }
-    case pmUnisonSpread:
-        *value = std::clamp(std::atof(display), 0., 100.);
-        return true;
-        break;
-
-    case pmOscDetune:
-        *value = std::clamp(std::atof(display), -200.0, 200.0);
-        return true;
-        break;
-    case pmCutoff:
+    case ParamDesc::HZ:
     {
         // auto co = 440 * pow(2.0, (value - 69) / 12);
         // log2(co/440) = (value - 69)/12
         // value = log2(co/440) * 12 + 69
-
         auto cohz = std::clamp(std::atof(display), 1.0, 25000.0);
-        *value = log2(cohz / 440.0) * 12 + 69;
-        return true;
+        res = log2(cohz / 440.0) * 12 + 69;
         break;
     }
-        // Skip these two. You get the idea
-    case pmFilterMode:
-    case pmAmpIsGate:
-        return false;
+    case ParamDesc::VOICES:
+        res = std::atoi(display);
         break;
+    case ParamDesc::CHOICE:
+    {
+        // Choices have to be typed exactly as we display them
+        auto n = (int)(d.max - d.min) + 1;
+        auto c = std::find_if(d.choices, d.choices + n,
+                              [display](auto *choice) { return strcmp(choice, display) == 0; });
+        if (c == d.choices + n)
+            return false;
+        res = d.min + (c - d.choices);
+        break;
+    }
     }
 
-    return false;
+    *value = std::clamp(res, d.min, d.max);
+    return true;
 }
 
 /*
@@ -329,6 +213,82 @@ bool ClapSawDemo::notePortsInfo(uint32_t index, bool isInput,
     return false;
 }
 
+bool ClapSawDemo::activate(double sampleRate, uint32_t minFrameCount,
+                           uint32_t maxFrameCount) noexcept
+{
+    /*
+     * A new pool size means new voices, and a new oversampling factor a new rate for them,
+     * so either way we start over with nothing playing. Otherwise the voices carry on as
+     * they were.
+     */
+    auto polyphony = polyphonyFromParam();
+    auto factor = oversamplingFromParam();
+    auto latencyChanged = factor != oversampling;
+    if ((int)voices.size() != polyphony || factor != oversampling)
+    {
+        voices = std::vector<SawDemoVoice>(polyphony);
+        activeVoices.assign(polyphony, 0);
+        activeVoicePosition.assign(polyphony, -1);
+        activeVoiceCount = 0;
+        voiceIndex.clear();
+        voiceAllocator.reset(polyphony);
+        dataCopyForUI.polyphony = 0;
+    }
+    restartRequested = false;
+
+    oversampling = factor;
+    auto voiceRate = sampleRate * oversampling;
+    monoMod.sampleRate = voiceRate;
+    updateMonoModFilter();
+
+    auto &wt = SawWavetable::instance();
+    for (auto &v : voices)
+    {
+        v.sampleRate = voiceRate;
+        v.controlRateScale = oversampling;
+        v.wavetable = &wt;
+        v.monoMod = &monoMod;
+    }
+    for (auto &s : renderScratch)
+        s.assign(maxFrameCount, 0.f);
+
+    renderTasks.resize((polyphony + voices_per_task - 1) / voices_per_task);
+    for (auto &t : renderTasks)
+        for (auto &s : t.scratch)
+            s.assign(maxFrameCount * oversampling, 0.f);
+    renderTaskCount = 0;
+
+    for (auto &b : oversampledBus)
+        b.assign(oversampling > 1 ? maxFrameCount * oversampling : 0, 0.f);
+    decimator.setup(oversampling, maxFrameCount);
+
+    // The host may only be told the latency changed here in activate
+    if (latencyChanged && _host.canUseLatency())
+        _host.latencyChanged();
+
+    /*
+     * The shared pool outlives any one instance, so taking our share is cheap unless we
+     * are the first. If every job slot is taken we just render without it.
+     */
+    workerPoolWanted = wantsWorkerPool();
+    if (workerPoolWanted && !workerPool)
+    {
+        workerPool = WorkerPool::acquire();
+        if (!workerPool->registerJob(workerJob))
+            workerPool.reset();
+    }
+    return true;
+}
+
+void ClapSawDemo::deactivate() noexcept
+{
+    if (workerPool)
+    {
+        workerPool->unregisterJob(workerJob);
+        workerPool.reset();
+    }
+}
+
 /*
  * The process function is the heart of any CLAP. It reads inbound events,
  * generates audio if appropriate, writes outbound events, and informs the host
@@ -340,14 +300,17 @@ bool ClapSawDemo::notePortsInfo(uint32_t index, bool isInput,
  *    see the discussion in the clap header file for this structure), apply them
  *    to my internal state, and generate CLAP changed messages
  *
- * 2. Iterate over samples rendering the voices, and if an inbound event is coincident
- *    with a sample, process that event for note on, modulation, parameter automation, and so on
+ * 2. Split the block at the inbound event times. Process the events for note on, modulation,
+ *    parameter automation and so on at their sample, and render the voices across each
+ *    event-free span in between
  *
  * 3. Detect any voices which have terminated in the block (their state has become 'NEWLY_OFF'),
  *    update them to 'OFF' and send a CLAP NOTE_END event to terminate any polyphonic modulators.
  */
 clap_process_status ClapSawDemo::process(const clap_process *process) noexcept
 {
+    ScopedFlushDenormals noDenormals;
+
     // If I have no outputs, do nothing
     if (process->audio_outputs_count <= 0)
         return CLAP_PROCESS_SLEEP;
@@ -366,10 +329,13 @@ clap_process_status ClapSawDemo::process(const clap_process *process) noexcept
      * CLAP has a single inbound event loop where every event is time stamped with
      * a sample id. This means the process loop can easily interleave note and parameter
      * and other events with audio generation. Here we do everything completely sample accurately
-     * by maintaining a pointer to the 'nextEvent' which we check at every sample.
+     * by splitting the block at each event time: we apply every event which lands on the
+     * current sample, then render the event-free span up to the next event (or the end of
+     * the block) with one renderBlock call per voice.
      */
     float **out = process->audio_outputs[0].data32;
     auto chans = process->audio_outputs->channel_count;
+    auto frames = process->frames_count;
 
     auto ev = process->in_events;
     auto sz = ev->size(ev);
@@ -382,44 +348,66 @@ clap_process_status ClapSawDemo::process(const clap_process *process) noexcept
         nextEvent = ev->get(ev, nextEventIndex);
     }
 
-    for (int i = 0; i < process->frames_count; ++i)
+    auto advanceEvent = [&]()
+    {
+        // handleInboundEvent is a separate function which adjusts the state based
+        // on event type. We segregate it for clarity but you really should read it!
+        handleInboundEvent(nextEvent);
+        nextEventIndex++;
+        if (nextEventIndex >= sz)
+            nextEvent = nullptr;
+        else
+            nextEvent = ev->get(ev, nextEventIndex);
+    };
+
+    for (uint32_t ch = 0; ch < chans; ++ch)
+    {
+        std::fill(out[ch], out[ch] + frames, 0.f);
+    }
+
+    // Oversampled, the voices render into our bus at their rate instead, and we bring it
+    // back to the host rate once the whole block is in
+    float *bus[2] = {oversampledBus[0].data(), oversampledBus[1].data()};
+    auto renderOut = out;
+    auto renderChans = chans;
+    if (oversampling > 1)
+    {
+        for (auto *b : bus)
+            std::fill(b, b + frames * oversampling, 0.f);
+        renderOut = bus;
+        renderChans = 2;
+    }
+
+    uint32_t pos{0};
+    while (pos < frames)
     {
         // Do I have an event to process. Note that multiple events
         // can occur on the same sample, hence 'while' not 'if'
-        while (nextEvent && nextEvent->time == i)
+        while (nextEvent && nextEvent->time <= pos)
         {
-            // handleInboundEvent is a separate function which adjusts the state based
-            // on event type. We segregate it for clarity but you really should read it!
-            handleInboundEvent(nextEvent);
-            nextEventIndex++;
-            if (nextEventIndex >= sz)
-                nextEvent = nullptr;
-            else
-                nextEvent = ev->get(ev, nextEventIndex);
+            advanceEvent();
         }
 
-        // This is a simple accumulator of output across our active voices.
-        // See saw-voice.h for information on the individual voice.
-        for (int ch = 0; ch < chans; ++ch)
-        {
-            out[ch][i] = 0.f;
-        }
-        for (auto &v : voices)
-        {
-            if (v.isPlaying())
-            {
-                v.step();
-                if (chans >= 2)
-                {
-                    out[0][i] += v.L;
-                    out[1][i] += v.R;
-                }
-                else if (chans == 1)
-                {
-                    out[0][i] += (v.L + v.R) * 0.5;
-                }
-            }
-        }
+        auto spanEnd = frames;
+        if (nextEvent)
+            spanEnd = std::min(nextEvent->time, frames);
+
+        // However many param changes landed on this sample, the voices catch up just once
+        if (dirtyParams)
+            pushParamsToVoices();
+
+        renderVoices(renderOut, renderChans, pos * oversampling, (spanEnd - pos) * oversampling);
+        pos = spanEnd;
+    }
+
+    if (oversampling > 1 && chans > 0)
+        decimateBus(out, chans, frames);
+
+    // A misbehaving host could hand us events stamped past the end of the block. Apply them
+    // so our state stays consistent, even though they can no longer affect this block's audio
+    while (nextEvent)
+    {
+        advanceEvent();
     }
 
     /*
@@ -432,13 +420,18 @@ clap_process_status ClapSawDemo::process(const clap_process *process) noexcept
      * Note that there are two ways to enter the terminatedVoices array. The first
      * is here through natural state transition to NEWLY_OFF and the second is in
      * handleNoteOn when we steal a voice.
+     *
+     * We walk the active list backwards since retiring a voice swaps the last
+     * active entry into its slot.
      */
-    for (auto &v : voices)
+    for (int i = activeVoiceCount - 1; i >= 0; --i)
     {
+        auto &v = voices[activeVoices[i]];
         if (v.state == SawDemoVoice::NEWLY_OFF)
         {
             terminatedVoices.emplace_back(v.portid, v.channel, v.key, v.note_id);
             v.state = SawDemoVoice::OFF;
+            retireVoice(activeVoices[i]);
         }
     }
 
@@ -469,17 +462,184 @@ clap_process_status ClapSawDemo::process(const clap_process *process) noexcept
     assert(!nextEvent);
 
     // A little optimization - if we have any active voices continue
-    for (const auto &v : voices)
+    if (activeVoiceCount > 0)
+        return CLAP_PROCESS_CONTINUE;
+
+    // Otherwise we have no voices - we can return CLAP_PROCESS_SLEEP until we get the next event
+    // And our host can optionally skip processing
+    return CLAP_PROCESS_SLEEP;
+}
+
+/*
+ * renderVoices accumulates every playing voice into out[][offset, offset + n). The stereo
+ * case renders straight into the host buffers; mono renders into our scratch pair (sized
+ * in activate) and folds that down. With enough voices active we render them in thread
+ * pool tasks and sum the results; see threadPoolExec.
+ */
+void ClapSawDemo::renderVoices(float **out, uint32_t chans, uint32_t offset, uint32_t n)
+{
+    if (n == 0 || chans == 0)
+        return;
+
+    advanceControlTicks(n);
+
+    auto renderInto = [&](float *L, float *R)
     {
-        if (v.state != SawDemoVoice::OFF)
+        if (activeVoiceCount < thread_pool_min_voices)
         {
-            return CLAP_PROCESS_CONTINUE;
+            renderVoiceRange(voiceBank, 0, activeVoiceCount, L, R, n);
+            return;
         }
+
+        /*
+         * Every task renders into its own scratch, and we sum them in task order below,
+         * whether the host ran them for us or not. That keeps the output independent of
+         * how (and whether) the work was spread across threads.
+         */
+        renderTaskCount = (activeVoiceCount + voices_per_task - 1) / voices_per_task;
+        renderTaskFrames = n;
+        auto ran = _host.canUseThreadPool() && _host.threadPoolRequestExec(renderTaskCount);
+        if (!ran && workerPool)
+        {
+            auto exec = [](void *self, uint32_t t)
+            { static_cast<ClapSawDemo *>(self)->threadPoolExec(t); };
+            ran = workerPool->run(workerJob, renderTaskCount, exec, this);
+        }
+        if (!ran)
+        {
+            for (int t = 0; t < renderTaskCount; ++t)
+                threadPoolExec(t);
+        }
+
+        for (int t = 0; t < renderTaskCount; ++t)
+        {
+            const float *tL = renderTasks[t].scratch[0].data();
+            const float *tR = renderTasks[t].scratch[1].data();
+            for (uint32_t i = 0; i < n; ++i)
+            {
+                L[i] += tL[i];
+                R[i] += tR[i];
+            }
+        }
+        renderTaskCount = 0;
+    };
+
+    if (chans >= 2)
+    {
+        renderInto(out[0] + offset, out[1] + offset);
+    }
+    else
+    {
+        float *sL = renderScratch[0].data(), *sR = renderScratch[1].data();
+        std::fill(sL, sL + n, 0.f);
+        std::fill(sR, sR + n, 0.f);
+        renderInto(sL, sR);
+        for (uint32_t i = 0; i < n; ++i)
+            out[0][offset + i] += (sL[i] + sR[i]) * 0.5;
     }
+}
 
-    // Otherwise we have no voices - we can return CLAP_PROCESS_SLEEP until we get the next event
-    // And our host can optionally skip processing
-    return CLAP_PROCESS_SLEEP;
+// Decimates the oversampled bus into the host's outputs, folding it to mono if need be
+void ClapSawDemo::decimateBus(float **out, uint32_t chans, uint32_t frames)
+{
+    float *bL = oversampledBus[0].data(), *bR = oversampledBus[1].data();
+    if (chans >= 2)
+    {
+        decimator.process(bL, bR, out[0], out[1], frames);
+        return;
+    }
+
+    float *sL = renderScratch[0].data(), *sR = renderScratch[1].data();
+    decimator.process(bL, bR, sL, sR, frames);
+    for (uint32_t i = 0; i < frames; ++i)
+        out[0][i] = (sL[i] + sR[i]) * 0.5;
+}
+
+// Moves tickLeft on n samples the way SawDemoVoice::renderBlock moves a voice's
+void ClapSawDemo::advanceControlTicks(uint32_t n)
+{
+    auto rate = filterGlideFromParam();
+    if (rate == 0)
+        rate = SawDemoVoice::control_rate * oversampling;
+
+    while (n > 0)
+    {
+        if (tickLeft <= 0)
+            tickLeft = rate;
+        auto m = std::min((uint32_t)tickLeft, n);
+        tickLeft -= m;
+        n -= m;
+    }
+}
+
+/*
+ * renderVoiceRange accumulates the playing voices in activeVoices[from, to) into L and R.
+ * Depending on the voice engine parameter they either render one by one, or in groups
+ * through the voice-parallel bank, which is why the caller hands us the bank to use.
+ */
+void ClapSawDemo::renderVoiceRange(SawDemoVoiceBank &bank, int from, int to, float *L, float *R,
+                                   uint32_t n)
+{
+    if (static_cast<int>(paramValue(pmVoiceEngine)) == VOICE_PARALLEL)
+    {
+        SawDemoVoice *group[SawDemoVoiceBank::bank_lanes];
+        int ng{0};
+        for (int i = from; i < to; ++i)
+        {
+            auto &v = voices[activeVoices[i]];
+            if (!v.isPlaying())
+                continue;
+
+            // The bank only runs the DPW oscillator, so wavetable voices go on their own
+            if (v.usesWavetable)
+            {
+                v.renderBlock(L, R, n);
+                continue;
+            }
+
+            group[ng++] = &v;
+            if (ng == SawDemoVoiceBank::bank_lanes)
+            {
+                bank.renderBlock(group, ng, L, R, n);
+                ng = 0;
+            }
+        }
+        if (ng > 0)
+            bank.renderBlock(group, ng, L, R, n);
+    }
+    else
+    {
+        for (int i = from; i < to; ++i)
+        {
+            auto &v = voices[activeVoices[i]];
+            if (v.isPlaying())
+                v.renderBlock(L, R, n);
+        }
+    }
+}
+
+/*
+ * threadPoolExec renders one task's voices into its scratch. The host calls it from its
+ * pool threads during threadPoolRequestExec, our WorkerPool from its workers, and
+ * renderVoices directly if there is neither. Tasks own disjoint voices, banks and
+ * scratch, and only read the shared engine state, so they can run concurrently.
+ */
+void ClapSawDemo::threadPoolExec(uint32_t taskIndex) noexcept
+{
+    if ((int)taskIndex >= renderTaskCount)
+        return;
+
+    // Pool threads don't share process's floating point mode
+    ScopedFlushDenormals noDenormals;
+
+    auto &task = renderTasks[taskIndex];
+    float *L = task.scratch[0].data(), *R = task.scratch[1].data();
+    std::fill(L, L + renderTaskFrames, 0.f);
+    std::fill(R, R + renderTaskFrames, 0.f);
+
+    auto from = (int)taskIndex * voices_per_task;
+    auto to = std::min(from + voices_per_task, activeVoiceCount);
+    renderVoiceRange(task.bank, from, to, L, R, renderTaskFrames);
 }
 
 /*
@@ -525,22 +685,21 @@ void ClapSawDemo::handleInboundEvent(const clap_event_header_t *evt)
             // pitch bend
             auto bv = (mevt->data[1] + mevt->data[2] * 128 - 8192) / 8192.0;
 
-            for (auto &v : voices)
-            {
-                v.pitchBendWheel = bv * 2; // just hardcode a pitch bend depth of 2
-                v.recalcPitch();
-            }
-
+            // A 14-bit controller can send dozens of these a block, so just keep the latest
+            // and let pushParamsToVoices repitch the voices once before we next render
+            pitchBendPosition = bv;
+            dirtyParams |= pgBend;
             break;
         }
         }
         break;
     }
     /*
-     * CLAP_EVENT_NOTE_ON and OFF simply deliver the event to the note creators below,
-     * which find (probably) and activate a spare or playing voice. Our 'voice stealing'
-     * algorithm here is 'just don't play a note 65 if 64 are ringing. Remember this is an
-     * example synth!
+     * CLAP_EVENT_NOTE_ON and OFF simply deliver the event to the note creators below.
+     * A note on takes a voice off the allocator's free stack. If none are free it steals
+     * one, picking by the Voice Stealing param from the queues of voices in the order they
+     * started and were released: the oldest released voice, falling back to the oldest
+     * held one, or just the oldest. See voice-allocator.h.
      */
     case CLAP_EVENT_NOTE_ON:
     {
@@ -556,15 +715,20 @@ void ClapSawDemo::handleInboundEvent(const clap_event_header_t *evt)
     break;
     /*
      * CLAP_EVENT_PARAM_VALUE sets a value. What happens if you change a parameter
-     * outside a modulation context. We simply update our engine value and, if an editor
-     * is attached, send an editor message.
+     * outside a modulation context. We simply update our engine value, mark what depends
+     * on it as dirty for the next pushParamsToVoices, and, if an editor is attached, send
+     * an editor message.
      */
     case CLAP_EVENT_PARAM_VALUE:
     {
         auto v = reinterpret_cast<const clap_event_param_value *>(evt);
 
-        *paramToValue[v->param_id] = v->value;
-        pushParamsToVoices();
+        auto idx = paramIndex(v->param_id);
+        if (idx < 0)
+            break;
+
+        paramValues[idx] = v->value;
+        dirtyParams |= paramDescs[idx].groups;
 
         if (editor)
         {
@@ -631,56 +795,72 @@ void ClapSawDemo::handleInboundEvent(const clap_event_header_t *evt)
          * The real meat is here. If we have a note id, find the note and modulate it.
          * Otherwise if we have a key (we are doing "PCK modulation" rather than "noteid
          * modulation") find a voice and update that. Otherwise it is a monophonic modulation
-         * so update every voice.
+         * which goes in monoMod, shared by every voice, with the filter computed just once.
+         * Pitch depends on the key so each voice still works that out itself, and voices
+         * with polyphonic filter modulation do the same for their filter.
          */
         if (pevt->note_id >= 0)
         {
             // poly by note_id
-            for (auto &v : voices)
-            {
-                if (v.note_id == pevt->note_id)
-                {
-                    applyToVoice(v);
-                }
-            }
+            voiceIndex.forEachWithNoteId(pevt->note_id,
+                                         [&](int idx) { applyToVoice(voices[idx]); });
         }
         else if (pevt->key >= 0 && pevt->channel >= 0 && pevt->port_index >= 0)
         {
             // poly by PCK
-            for (auto &v : voices)
-            {
-                if (v.key == pevt->key && v.channel == pevt->channel &&
-                    v.portid == pevt->port_index)
-                {
-                    applyToVoice(v);
-                }
-            }
+            voiceIndex.forEachWithKey(pevt->port_index, pevt->channel, pevt->key,
+                                      [&](int idx) { applyToVoice(voices[idx]); });
         }
         else
         {
             // mono
-            for (auto &v : voices)
+            auto groups = pgNone;
+            switch (pevt->param_id)
             {
-                applyToVoice(v);
+            case paramIds::pmCutoff:
+                monoMod.cutoffMod = pevt->amount;
+                groups = pgFilter;
+                break;
+            case paramIds::pmResonance:
+                monoMod.resMod = pevt->amount;
+                groups = pgFilter;
+                break;
+            case paramIds::pmUnisonSpread:
+                monoMod.uniSpreadMod = pevt->amount;
+                groups = pgPitch;
+                break;
+            case paramIds::pmOscDetune:
+                monoMod.oscDetuneMod = pevt->amount;
+                groups = pgPitch;
+                break;
+            case paramIds::pmPreFilterVCA:
+                // The voices add this in as they render
+                monoMod.preFilterVCAMod = pevt->amount;
+                break;
             }
+
+            // As with a param value, the voices catch up once in pushParamsToVoices
+            dirtyParams |= groups;
         }
     }
     break;
     /*
-     * Note expression handling is similar to polymod. Traverse the voices - in note expression
+     * Note expression handling is similar to polymod. Look up the voices - in note expression
      * indexed by channel / key / port - and adjust the modulation slot in each.
      */
     case CLAP_EVENT_NOTE_EXPRESSION:
     {
         auto pevt = reinterpret_cast<const clap_event_note_expression *>(evt);
-        for (auto &v : voices)
-        {
-            if (!v.isPlaying())
-                continue;
 
-            // Note expressions work on key not note id
-            if (v.key == pevt->key && v.channel == pevt->channel && v.portid == pevt->port_index)
+        // Note expressions work on key not note id
+        voiceIndex.forEachWithKey(
+            pevt->port_index, pevt->channel, pevt->key,
+            [&](int idx)
             {
+                auto &v = voices[idx];
+                if (!v.isPlaying())
+                    return;
+
                 switch (pevt->expression_id)
                 {
                 case CLAP_NOTE_EXPRESSION_VOLUME:
@@ -692,8 +872,7 @@ void ClapSawDemo::handleInboundEvent(const clap_event_header_t *evt)
                     v.recalcPitch();
                     break;
                 }
-            }
-        }
+            });
     }
     break;
     }
@@ -701,7 +880,6 @@ void ClapSawDemo::handleInboundEvent(const clap_event_header_t *evt)
 
 void ClapSawDemo::handleEventsFromUIQueue(const clap_output_events_t *ov)
 {
-    bool uiAdjustedValues{false};
     ClapSawDemo::FromUI r;
     while (fromUiQ.try_dequeue(r))
     {
@@ -725,7 +903,11 @@ void ClapSawDemo::handleEventsFromUIQueue(const clap_output_events_t *ov)
         case FromUI::ADJUST_VALUE:
         {
             // So set my value
-            *paramToValue[r.id] = r.value;
+            auto idx = paramIndex(r.id);
+            if (idx < 0)
+                break;
+            paramValues[idx] = r.value;
+            dirtyParams |= paramDescs[idx].groups;
 
             // But we also need to generate outbound message to the host
             auto evt = clap_event_param_value();
@@ -738,8 +920,6 @@ void ClapSawDemo::handleEventsFromUIQueue(const clap_output_events_t *ov)
             evt.value = r.value;
 
             ov->try_push(ov, &(evt.header));
-
-            uiAdjustedValues = true;
         }
         }
     }
@@ -750,18 +930,15 @@ void ClapSawDemo::handleEventsFromUIQueue(const clap_output_events_t *ov)
         _DBGCOUT << "Pushing a refresh of UI values to the editor" << std::endl;
         refreshUIValues = false;
 
-        for (const auto &[k, v] : paramToValue)
+        for (int i = 0; i < nParams; ++i)
         {
             auto r = ToUI();
             r.type = ToUI::PARAM_VALUE;
-            r.id = k;
-            r.value = *v;
+            r.id = paramDescs[i].id;
+            r.value = paramValues[i];
             toUiQ.try_enqueue(r);
         }
     }
-
-    if (uiAdjustedValues)
-        pushParamsToVoices();
 }
 
 /*
@@ -770,26 +947,21 @@ void ClapSawDemo::handleEventsFromUIQueue(const clap_output_events_t *ov)
  */
 void ClapSawDemo::handleNoteOn(int port_index, int channel, int key, int noteid)
 {
-    bool foundVoice{false};
-    for (auto &v : voices)
+    auto idx = voiceAllocator.allocate();
+    if (idx < 0)
     {
-        if (v.state == SawDemoVoice::OFF)
-        {
-            activateVoice(v, port_index, channel, key, noteid);
-            foundVoice = true;
-            break;
-        }
-    }
-
-    if (!foundVoice)
-    {
-        // We could steal oldest. If you want to do that toss in a PR to add age
-        // to the voice I guess. This is just a demo synth though.
-        auto idx = rand() % max_voices;
+        // Every voice is busy, so steal one. It ends as far as the host is concerned, so
+        // it goes in terminatedVoices, and activateVoice restarts it on the new note.
+        auto policy = (VoiceAllocator<max_voices>::StealPolicy) static_cast<int>(
+            paramValue(pmStealPolicy));
+        idx = voiceAllocator.steal(policy);
+        if (idx < 0)
+            return; // no voices yet, as we haven't been activated
         auto &v = voices[idx];
         terminatedVoices.emplace_back(v.portid, v.channel, v.key, v.note_id);
-        activateVoice(v, port_index, channel, key, noteid);
+        dataCopyForUI.voicesStolen = (uint32_t)voiceAllocator.stealCount();
     }
+    activateVoice(voices[idx], port_index, channel, key, noteid);
 
     dataCopyForUI.updateCount++;
     dataCopyForUI.polyphony++;
@@ -805,13 +977,16 @@ void ClapSawDemo::handleNoteOn(int port_index, int channel, int key, int noteid)
 
 void ClapSawDemo::handleNoteOff(int port_index, int channel, int n)
 {
-    for (auto &v : voices)
-    {
-        if (v.isPlaying() && v.key == n && v.portid == port_index && v.channel == channel)
-        {
-            v.release();
-        }
-    }
+    voiceIndex.forEachWithKey(port_index, channel, n,
+                              [this](int idx)
+                              {
+                                  auto &v = voices[idx];
+                                  if (v.isPlaying())
+                                  {
+                                      v.release();
+                                      voiceAllocator.noteReleased(idx);
+                                  }
+                              });
 
     if (editor)
     {
@@ -824,20 +999,34 @@ void ClapSawDemo::handleNoteOff(int port_index, int channel, int n)
 
 void ClapSawDemo::activateVoice(SawDemoVoice &v, int port_index, int channel, int key, int noteid)
 {
-    v.unison = std::max(1, std::min(7, (int)unisonCount));
-    v.filterMode = (int)static_cast<int>(filterMode);
+    // A stolen voice is already on the active list; a fresh one needs adding
+    auto idx = (int)(&v - voices.data());
+    if (activeVoicePosition[idx] < 0)
+    {
+        activeVoicePosition[idx] = activeVoiceCount;
+        activeVoices[activeVoiceCount++] = idx;
+    }
+    voiceIndex.add(idx, port_index, channel, key, noteid);
+    voiceAllocator.noteStarted(idx);
+
+    v.unison = std::max(1, std::min(7, (int)paramValue(pmUnisonCount)));
+    v.oscEngine = static_cast<int>(paramValue(pmOscEngine));
+    v.filterMode = (int)static_cast<int>(paramValue(pmFilterMode));
     v.note_id = noteid;
     v.portid = port_index;
     v.channel = channel;
 
-    v.uniSpread = unisonSpread;
-    v.oscDetune = oscDetune;
-    v.cutoff = cutoff;
-    v.res = resonance;
-    v.preFilterVCA = preFilterVCA;
-    v.ampRelease = scaleTimeParamToSeconds(ampRelease);
-    v.ampAttack = scaleTimeParamToSeconds(ampAttack);
-    v.ampGate = ampIsGate > 0.5;
+    v.uniSpread = paramValue(pmUnisonSpread);
+    v.oscDetune = paramValue(pmOscDetune);
+    v.cutoff = paramValue(pmCutoff);
+    v.res = paramValue(pmResonance);
+    v.filterGlide = filterGlideFromParam();
+    v.tickLeft = tickLeft;
+    v.preFilterVCA = paramValue(pmPreFilterVCA);
+    v.ampRelease = scaleTimeParamToSeconds(paramValue(pmAmpRelease));
+    v.ampAttack = scaleTimeParamToSeconds(paramValue(pmAmpAttack));
+    v.ampGate = paramValue(pmAmpIsGate) > 0.5;
+    v.ampCurve = ampCurveFromParam();
 
     // reset all the modulations
     v.cutoffMod = 0;
@@ -847,10 +1036,23 @@ void ClapSawDemo::activateVoice(SawDemoVoice &v, int port_index, int channel, in
     v.uniSpreadMod = 0;
     v.volumeNoteExpressionValue = 0;
     v.pitchNoteExpressionValue = 0;
+    v.pitchBendWheel = pitchBendWheel;
 
     v.start(key);
 }
 
+void ClapSawDemo::retireVoice(int idx)
+{
+    auto pos = activeVoicePosition[idx];
+    assert(pos >= 0);
+    auto last = activeVoices[--activeVoiceCount];
+    activeVoices[pos] = last;
+    activeVoicePosition[last] = pos;
+    activeVoicePosition[idx] = -1;
+    voiceIndex.remove(idx);
+    voiceAllocator.free(idx);
+}
+
 /*
  * If the processing loop isn't running, the call to requestParamFlush from the UI will
  * result in this being called on the main thread, and generating all the appropriate
@@ -868,31 +1070,87 @@ void ClapSawDemo::paramsFlush(const clap_input_events *in, const clap_output_eve
     }
 
     handleEventsFromUIQueue(out);
+    if (dirtyParams)
+        pushParamsToVoices();
 
     // We will never generate a note end event with processing active, and we have no midi
     // output, so we are done.
 }
 
+/*
+ * pushParamsToVoices brings the playing voices up to date with the groups in dirtyParams,
+ * and only those, then clears them. The pitch and filter recalculations are the expensive
+ * part, so an envelope time change, say, no longer pays for them.
+ */
 void ClapSawDemo::pushParamsToVoices()
 {
-    for (auto &v : voices)
+    auto dirty = dirtyParams;
+    dirtyParams = pgNone;
+
+    if (dirty & pgFilter)
+        updateMonoModFilter();
+
+    if (dirty & pgBend)
+        pitchBendWheel = pitchBendPosition * paramValue(pmBendRange);
+
+    if (dirty & (pgPitch | pgBend | pgFilter | pgEnvelope | pgVCA))
     {
-        if (v.isPlaying())
+        auto release = scaleTimeParamToSeconds(paramValue(pmAmpRelease));
+        auto attack = scaleTimeParamToSeconds(paramValue(pmAmpAttack));
+
+        for (int i = 0; i < activeVoiceCount; ++i)
         {
-            v.uniSpread = unisonSpread;
-            v.oscDetune = oscDetune;
-            v.cutoff = cutoff;
-            v.res = resonance;
-            v.preFilterVCA = preFilterVCA;
-            v.ampRelease = scaleTimeParamToSeconds(ampRelease);
-            v.ampAttack = scaleTimeParamToSeconds(ampAttack);
-            v.ampGate = ampIsGate > 0.5;
-            v.filterMode = filterMode;
-
-            v.recalcPitch();
-            v.recalcFilter();
+            auto &v = voices[activeVoices[i]];
+            if (!v.isPlaying())
+                continue;
+
+            if (dirty & (pgPitch | pgBend))
+            {
+                v.uniSpread = paramValue(pmUnisonSpread);
+                v.oscDetune = paramValue(pmOscDetune);
+                v.pitchBendWheel = pitchBendWheel;
+                v.recalcPitch();
+            }
+            if (dirty & pgFilter)
+            {
+                // updateMonoModFilter has run by now, so most voices just copy its filter
+                v.cutoff = paramValue(pmCutoff);
+                v.res = paramValue(pmResonance);
+                v.filterMode = paramValue(pmFilterMode);
+                v.filterGlide = filterGlideFromParam();
+                v.recalcFilter();
+            }
+            if (dirty & pgEnvelope)
+            {
+                v.ampRelease = release;
+                v.ampAttack = attack;
+                v.ampGate = paramValue(pmAmpIsGate) > 0.5;
+                v.ampCurve = ampCurveFromParam();
+            }
+            if (dirty & pgVCA)
+                v.preFilterVCA = paramValue(pmPreFilterVCA);
         }
     }
+
+    if (!(dirty & pgEngine))
+        return;
+
+    auto poolChanged = wantsWorkerPool() != workerPoolWanted;
+    if (isActive() && !restartRequested &&
+        (polyphonyFromParam() != (int)voices.size() || poolChanged ||
+         oversamplingFromParam() != oversampling))
+    {
+        restartRequested = true;
+        _host.requestRestart();
+    }
+}
+
+void ClapSawDemo::updateMonoModFilter()
+{
+    monoMod.cutoff = paramValue(pmCutoff);
+    monoMod.res = paramValue(pmResonance);
+    monoMod.filterMode = static_cast<int>(paramValue(pmFilterMode));
+    monoMod.recalcFilter();
 }
 
 float ClapSawDemo::scaleTimeParamToSeconds(float param)
@@ -924,9 +1182,10 @@ bool ClapSawDemo::stateSave(const clap_ostream *stream) noexcept
     auto cloc = std::locale("C");
     oss.imbue(cloc);
     oss << "STREAM-VERSION-1;";
-    for (const auto &[id, val] : paramToValue)
+    for (int i = 0; i < nParams; ++i)
     {
-        oss << id << "=" << std::setw(30) << std::setprecision(20) << *val << ";";
+        oss << paramDescs[i].id << "=" << std::setw(30) << std::setprecision(20)
+            << paramValues[i] << ";";
     }
     _DBGCOUT << oss.str() << std::endl;
 
@@ -999,9 +1258,12 @@ bool ClapSawDemo::stateLoad(const clap_istream *stream) noexcept
         istr.imbue(std::locale("C"));
         istr >> val;
 
-        *(paramToValue[(paramIds)id]) = val;
+        auto idx = paramIndex(id);
+        if (idx >= 0)
+            paramValues[idx] = val;
     }
 
+    dirtyParams = pgAll;
     pushParamsToVoices();
     return true;
 }
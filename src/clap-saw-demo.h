@@ -21,9 +21,9 @@
  * - Hold the CLAP description static object
  * - Advertise parameters and ports
  * - Provide an event handler which responds to events and returns sound
- * - Do voice management. Which is really not very sophisticated (it's just an array of 64
- *   voice objects and we choose the next free one, and if you ask for a 65th voice, nothing
- *   happens).
+ * - Do voice management. The voices are a vector which activate sizes from the Max
+ *   Polyphony parameter (1 to 1024). A note takes the next free voice, and once they are all
+ *   in use it steals one as the Voice Stealing parameter says.
  * - Provide the API points to delegate UI creation to a separate editor object,
  *   coded in clap-saw-demo-editor
  *
@@ -36,12 +36,19 @@
 #include <clap/helpers/plugin.hh>
 #include <atomic>
 #include <array>
-#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <cmath>
 #include <memory>
 #include <readerwriterqueue.h>
 
 #include "saw-voice.h"
-#include <memory>
+#include "saw-voice-bank.h"
+#include "voice-index.h"
+#include "voice-allocator.h"
+#include "worker-pool.h"
+#include "halfband-decimator.h"
+#include "param-table.h"
 
 namespace sst::clap_saw_demo
 {
@@ -51,7 +58,9 @@ struct ClapSawDemoEditor;
 struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHandler::Terminate,
                                                   clap::helpers::CheckingLevel::Maximal>
 {
-    static constexpr int max_voices = 64;
+    // The voice pool is sized at activate from the Max Polyphony parameter, up to max_voices
+    static constexpr int max_voices = 1024;
+    static constexpr int default_polyphony = 64;
     ClapSawDemo(const clap_host *host);
     ~ClapSawDemo();
 
@@ -64,15 +73,18 @@ struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHan
     /*
      * Activate makes sure sampleRate is distributed through
      * the data structures, in this case by stamping the sampleRate
-     * onto each pre-allocated voice object.
+     * onto each pre-allocated voice object. It is also where we do all our
+     * allocation: the voice pool (sized from the Max Polyphony parameter),
+     * the scratch buffers we render into when the host hands us a mono output,
+     * and the shared wavetables (only the first activation builds those).
      */
     bool activate(double sampleRate, uint32_t minFrameCount,
-                  uint32_t maxFrameCount) noexcept override
-    {
-        for (auto &v : voices)
-            v.sampleRate = sampleRate;
-        return true;
-    }
+                  uint32_t maxFrameCount) noexcept override;
+
+    /*
+     * Deactivate lets go of our share of the internal worker pool, if we took one.
+     */
+    void deactivate() noexcept override;
 
     /*
      * Parameter Handling:
@@ -82,40 +94,158 @@ struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHan
      * I confuse creation index with param IDs, I am using arbitrary numbers for each
      * parameter id.
      *
-     * The implementation of paramsInfo contains the setup of these params.
+     * paramDescs below describes each of these params, and paramsInfo, the value and text
+     * conversions and the state all read from it.
      *
-     * The actual synth has a very simple model to update parameter values. It
-     * contains a map from these IDs to a double * which the constructor sets up
-     * as references to members.
+     * The actual synth has a very simple model to update parameter values. They live
+     * in one array, in table order, and paramHash finds the slot for an ID.
      */
     enum paramIds : uint32_t
     {
         pmUnisonCount = 1378,
         pmUnisonSpread = 2391,
         pmOscDetune = 8675309,
+        pmOscEngine = 5531,
+        pmBendRange = 3462,
 
         pmAmpAttack = 2874,
         pmAmpRelease = 728,
         pmAmpIsGate = 1942,
+        pmAmpCurve = 6629,
 
         pmPreFilterVCA = 87612,
 
         pmCutoff = 17,
         pmResonance = 94,
-        pmFilterMode = 14255
+        pmFilterMode = 14255,
+        pmFilterGlide = 5290,
+
+        pmVoiceEngine = 4113,
+        pmStealPolicy = 3817,
+        pmMaxPolyphony = 6401,
+        pmInternalThreads = 7230,
+        pmOversampling = 9147
     };
-    static constexpr int nParams = 10;
+    static constexpr int nParams = 19;
+
+    /*
+     * We have two ways to render a set of voices. PER_VOICE calls each voice's renderBlock,
+     * which vectorizes across that voice's unison. VOICE_PARALLEL hands the voices to a
+     * SawDemoVoiceBank in groups so each SIMD lane is a voice, which is the better choice
+     * with low unison counts and lots of notes. They sound the same.
+     */
+    enum VoiceEngine
+    {
+        PER_VOICE,
+        VOICE_PARALLEL
+    };
+
+    /*
+     * Which voice (or engine) state a param feeds. A param change just marks its groups
+     * dirty, and pushParamsToVoices redoes only the work for those, once per span of the
+     * block however many changes arrived.
+     */
+    enum ParamGroup : uint32_t
+    {
+        pgNone = 0,
+        pgPitch = 1 << 0,    // recalcPitch
+        pgFilter = 1 << 1,   // recalcFilter
+        pgEnvelope = 1 << 2, // the AEG times and bypass
+        pgVCA = 1 << 3,      // the pre-filter VCA level
+        pgEngine = 1 << 4,   // the pool sizes, which need a restart
+        pgBend = 1 << 5,     // the bend wheel or its range, so recalcPitch
+        pgAll = (1 << 6) - 1
+    };
+
+    /*
+     * The parameter table. Every param is automatable unless it says otherwise, and these
+     * are the ones which activate polyphonic modulation.
+     */
+    static constexpr uint32_t pmAuto = CLAP_PARAM_IS_AUTOMATABLE;
+    static constexpr uint32_t pmStep = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_STEPPED;
+    static constexpr uint32_t pmMod = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE |
+                                      CLAP_PARAM_IS_MODULATABLE_PER_NOTE_ID |
+                                      CLAP_PARAM_IS_MODULATABLE_PER_KEY;
+
+    static constexpr const char *gateNames[] = {"AEG On", "AEG Bypassed"};
+    static constexpr const char *ampCurveNames[] = {"Linear", "Exponential"};
+    static constexpr const char *filterModeNames[] = {"LowPass", "HighPass", "BandPass",
+                                                      "Notch",   "Peak",     "AllPass"};
+    static constexpr const char *filterGlideNames[] = {"Off", "8 Samples", "16 Samples",
+                                                       "32 Samples"};
+    static constexpr int filterGlideSamples[] = {0, 8, 16, 32};
+    static constexpr const char *voiceEngineNames[] = {"Per Voice", "Voice Parallel"};
+    static constexpr const char *oscEngineNames[] = {"DPW", "Wavetable (Linear)",
+                                                     "Wavetable (Cubic)"};
+    static constexpr const char *stealPolicyNames[] = {"Released First", "Oldest"};
+    static constexpr const char *offOnNames[] = {"Off", "On"};
+    static constexpr const char *oversamplingNames[] = {"Off", "2x", "4x"};
+
+    static constexpr std::array<ParamDesc, nParams> paramDescs{{
+        {pmUnisonCount, "Unison Count", "Oscillator", 1, SawDemoVoice::max_uni, 3, pmStep,
+         ParamDesc::VOICES, nullptr, pgNone},
+        {pmUnisonSpread, "Unison Spread in Cents", "Oscillator", 0, 100, 10, pmMod,
+         ParamDesc::CENTS, nullptr, pgPitch},
+        {pmOscDetune, "Oscillator Detuning (in cents)", "Oscillator", -200, 200, 0, pmMod,
+         ParamDesc::CENTS, nullptr, pgPitch},
+        {pmBendRange, "Pitch Bend Range", "Oscillator", 0, 24, 2, pmStep,
+         ParamDesc::SEMITONES, nullptr, pgBend},
+        {pmAmpAttack, "Amplitude Attack (s)", "Amplitude Envelope Generator", 0, 1, 0.01,
+         pmAuto, ParamDesc::SECONDS, nullptr, pgEnvelope},
+        {pmAmpRelease, "Amplitude Release (s)", "Amplitude Envelope Generator", 0, 1, 0.2,
+         pmAuto, ParamDesc::SECONDS, nullptr, pgEnvelope},
+        {pmAmpIsGate, "Deactivate Amp Envelope", "Amplitude Envelope Generator", 0, 1, 0,
+         pmStep, ParamDesc::CHOICE, gateNames, pgEnvelope},
+        {pmAmpCurve, "Amplitude Envelope Shape", "Amplitude Envelope Generator",
+         SawDemoVoice::AEG_LINEAR, SawDemoVoice::AEG_EXPONENTIAL, SawDemoVoice::AEG_LINEAR,
+         pmStep, ParamDesc::CHOICE, ampCurveNames, pgEnvelope},
+        {pmPreFilterVCA, "Pre Filter VCA", "Filter", 0, 1, 1, pmMod, ParamDesc::NUMBER,
+         nullptr, pgVCA},
+        {pmCutoff, "Cutoff in Keys", "Filter", 1, 127, 69, pmMod, ParamDesc::HZ, nullptr,
+         pgFilter},
+        {pmResonance, "Resonance", "Filter", 0, 1, 0.7, pmMod, ParamDesc::NUMBER, nullptr,
+         pgFilter},
+        {pmFilterMode, "Filter Type", "Filter", SawDemoVoice::StereoSimperSVF::Mode::LP,
+         SawDemoVoice::StereoSimperSVF::Mode::ALL, SawDemoVoice::StereoSimperSVF::Mode::LP,
+         pmStep, ParamDesc::CHOICE, filterModeNames, pgFilter},
+        {pmFilterGlide, "Filter Smoothing", "Filter", 0, 3, 2, pmStep, ParamDesc::CHOICE,
+         filterGlideNames, pgFilter},
+        {pmVoiceEngine, "Voice Engine", "Engine", PER_VOICE, VOICE_PARALLEL, PER_VOICE, pmStep,
+         ParamDesc::CHOICE, voiceEngineNames, pgNone},
+        {pmOscEngine, "Oscillator Engine", "Oscillator", SawDemoVoice::OSC_DPW,
+         SawDemoVoice::OSC_WAVETABLE_CUBIC, SawDemoVoice::OSC_DPW, pmStep, ParamDesc::CHOICE,
+         oscEngineNames, pgNone},
+        {pmStealPolicy, "Voice Stealing", "Engine", VoiceAllocator<max_voices>::RELEASED_FIRST,
+         VoiceAllocator<max_voices>::OLDEST, VoiceAllocator<max_voices>::RELEASED_FIRST, pmStep,
+         ParamDesc::CHOICE, stealPolicyNames, pgNone},
+        // These only apply at activate, so they are not something to automate
+        {pmMaxPolyphony, "Max Polyphony", "Engine", 1, max_voices, default_polyphony,
+         CLAP_PARAM_IS_STEPPED, ParamDesc::VOICES, nullptr, pgEngine},
+        {pmInternalThreads, "Internal Threads", "Engine", 0, 1, 0, CLAP_PARAM_IS_STEPPED,
+         ParamDesc::CHOICE, offOnNames, pgEngine},
+        {pmOversampling, "Oversampling", "Engine", 0, 2, 0, CLAP_PARAM_IS_STEPPED,
+         ParamDesc::CHOICE, oversamplingNames, pgEngine},
+    }};
+
+    static constexpr auto paramHash = makeParamHash(paramDescs);
+    static_assert(paramHash.isPerfect(), "No perfect hash for the parameter ids");
+
+    // The table index for a parameter id, or -1 if it isn't one of ours
+    static constexpr int paramIndex(clap_id paramId) { return paramHash.indexOf(paramId); }
 
     bool implementsParams() const noexcept override { return true; }
     bool isValidParamId(clap_id paramId) const noexcept override
     {
-        return paramToValue.find(paramId) != paramToValue.end();
+        return paramIndex(paramId) >= 0;
     }
     uint32_t paramsCount() const noexcept override { return nParams; }
     bool paramsInfo(uint32_t paramIndex, clap_param_info *info) const noexcept override;
     bool paramsValue(clap_id paramId, double *value) noexcept override
     {
-        *value = *paramToValue[paramId];
+        auto idx = paramIndex(paramId);
+        if (idx < 0)
+            return false;
+        *value = paramValues[idx];
         return true;
     }
 
@@ -124,9 +254,8 @@ struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHan
      * For instance we model filter cutoff in 12-TET MIDI Note space, so the value
      * "60" of pmCutoff shows as "261.6 hz" and "69" (concert A) as "440 hz". Similarly
      * this is where we show our time scaling for our attack and release, filter type,
-     * and so on. If you want, you can also implement paramsTextToValue which is the
-     * inverse function, for hosts which allow user typeins. In this example, we choose
-     * to not implement that.
+     * and so on, all following the Display of the param in paramDescs. paramsTextToValue
+     * is the inverse function, for hosts which allow user typeins.
      */
     bool paramsValueToText(clap_id paramId, double value, char *display,
                            uint32_t size) noexcept override;
@@ -163,12 +292,24 @@ struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHan
     bool implementsVoiceInfo() const noexcept override { return true; }
     bool voiceInfoGet(clap_voice_info *info) noexcept override
     {
-        info->voice_capacity = max_voices;
-        info->voice_count = max_voices;
+        auto n = voices.empty() ? polyphonyFromParam() : (int)voices.size();
+        info->voice_capacity = n;
+        info->voice_count = n;
         info->flags = CLAP_VOICE_INFO_SUPPORTS_OVERLAPPING_NOTES;
         return true;
     }
 
+    /*
+     * Oversampled, the decimator delays our output by a handful of samples, which we
+     * report, rounded to the nearest, so the host can line us up with everything else.
+     * It only changes at activate, when we call latency changed.
+     */
+    bool implementsLatency() const noexcept override { return true; }
+    uint32_t latencyGet() const noexcept override
+    {
+        return (uint32_t)std::lround(decimator.delay());
+    }
+
     /*
      * I have an unacceptably crude state dump and restore. If you want to
      * improve it, PRs welcome! But it's just like any other read-and-write-goop
@@ -186,10 +327,27 @@ struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHan
      */
     clap_process_status process(const clap_process *process) noexcept override;
     void handleInboundEvent(const clap_event_header_t *evt);
+    void renderVoices(float **out, uint32_t chans, uint32_t offset, uint32_t n);
+    void renderVoiceRange(SawDemoVoiceBank &bank, int from, int to, float *L, float *R,
+                          uint32_t n);
+
+    /*
+     * With thread_pool_min_voices or more voices active, renderVoices splits them into
+     * tasks of voices_per_task which each render into their own scratch, and then sums
+     * those in task order. If the host has a thread pool the tasks run on it, otherwise
+     * we run them one after the other ourselves; the output is bit-identical either way.
+     *
+     * Hosts without a pool can still spread the tasks across threads if the user turns on
+     * Internal Threads, which runs them on our own process-wide WorkerPool instead.
+     */
+    bool implementsThreadPool() const noexcept override { return true; }
+    void threadPoolExec(uint32_t taskIndex) noexcept override;
     void pushParamsToVoices();
+    uint32_t dirtyParams{pgNone}; // ParamGroups changed since the last pushParamsToVoices
     void handleNoteOn(int port_index, int channel, int key, int noteid);
     void handleNoteOff(int port_index, int channel, int key);
     void activateVoice(SawDemoVoice &v, int port_index, int channel, int key, int noteid);
+    void retireVoice(int idx);
     void handleEventsFromUIQueue(const clap_output_events_t *);
 
     /*
@@ -338,6 +496,7 @@ struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHan
         std::atomic<uint32_t> updateCount{0};
         std::atomic<bool> isProcessing{false};
         std::atomic<int> polyphony{0};
+        std::atomic<uint32_t> voicesStolen{0};
     } dataCopyForUI;
 
     typedef moodycamel::ReaderWriterQueue<ToUI, 4096> SynthToUI_Queue_t;
@@ -350,15 +509,112 @@ struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHan
     ClapSawDemoEditor *editor{nullptr};
 
     // These items are ONLY read and written on the audio thread, so they
-    // are safe to be non-atomic doubles. We keep a map to locate them
-    // for parameter updates.
-    double unisonCount{3}, unisonSpread{10}, oscDetune{0}, cutoff{69}, resonance{0.7},
-        ampAttack{0.01}, ampRelease{0.2}, ampIsGate{0}, preFilterVCA{1.0}, filterMode{0};
-    std::unordered_map<clap_id, double *> paramToValue;
-
-    // "Voice Management" is "randomly pick a voice to kill and put it in stolen voices"
-    std::array<SawDemoVoice, max_voices> voices;
+    // are safe to be non-atomic doubles. They are in paramDescs order, and start
+    // at the defaults there.
+    std::array<double, nParams> paramValues;
+    double &paramValue(paramIds id) { return paramValues[paramIndex(id)]; }
+    double paramValue(paramIds id) const { return paramValues[paramIndex(id)]; }
+
+    // Our voices. The pool is allocated in activate and only resized by another activate
+    // with a different Max Polyphony, never while processing. voiceAllocator hands out the
+    // free ones and picks which to steal when there are none.
+    std::vector<SawDemoVoice> voices;
+    VoiceAllocator<max_voices> voiceAllocator;
+    int polyphonyFromParam() const
+    {
+        return std::clamp((int)paramValue(pmMaxPolyphony), 1, (int)max_voices);
+    }
+    // How many voice samples a filter change glides over, which is also its control rate.
+    // The choices are in host samples, so the glide takes as long whatever the oversampling.
+    int filterGlideFromParam() const
+    {
+        auto choice = std::clamp((int)std::round(paramValue(pmFilterGlide)), 0, 3);
+        return filterGlideSamples[choice] * oversampling;
+    }
+    SawDemoVoice::AEGCurve ampCurveFromParam() const
+    {
+        return paramValue(pmAmpCurve) > 0.5 ? SawDemoVoice::AEG_EXPONENTIAL
+                                            : SawDemoVoice::AEG_LINEAR;
+    }
+
+    // Samples to the next voice control tick. We count along with the voices, so a voice
+    // started between ticks takes its first one with the rest and they stay lined up.
+    int tickLeft{0};
+    void advanceControlTicks(uint32_t n);
+
+    // Max Polyphony, Internal Threads and Oversampling only take effect on activate, so
+    // changing them asks the host to restart us
+    bool restartRequested{false};
+
+    // Every voice which isn't OFF has its index packed into the front activeVoiceCount
+    // slots of activeVoices, and activeVoicePosition maps back (or is -1 for an OFF voice).
+    // Voices join in activateVoice and leave in retireVoice when stage 3 turns them OFF,
+    // so every per-voice loop in the engine only has to walk the live ones.
+    std::vector<int> activeVoices;
+    std::vector<int> activeVoicePosition;
+    int activeVoiceCount{0};
+
+    // Finds the active voices for a note_id or a port / channel / key. Kept in step with
+    // the active list in activateVoice and retireVoice.
+    VoiceIndex<max_voices> voiceIndex;
+
+    /*
+     * The last bend wheel position, in -1..1. A bend message only records it and marks
+     * pgBend, so however many arrive on a sample, pushParamsToVoices scales it by the bend
+     * range into pitchBendWheel (in semitones) and repitches the playing voices once.
+     * Voices started later pick up pitchBendWheel in activateVoice.
+     */
+    double pitchBendPosition{0.0};
+    float pitchBendWheel{0.f};
+
+    // Monophonic modulation, and the filter for it, which every voice points at
+    SawDemoVoice::MonoModulation monoMod;
+    void updateMonoModFilter();
+
+    // The VOICE_PARALLEL engine's lane storage, reused for each group of voices
+    SawDemoVoiceBank voiceBank;
     std::vector<std::tuple<int, int, int, int>> terminatedVoices; // that's PCK ID
+
+    // Stereo scratch for hosts which give us a mono output. Sized in activate.
+    std::array<std::vector<float>, 2> renderScratch;
+
+    /*
+     * Oversampled, the voices run at oversampling times the host rate. They render the
+     * block into oversampledBus, and decimateBus brings the summed bus back to the host
+     * rate once at the end, so the decimation costs the same however many voices play.
+     * The factor is fixed at activate, which sizes the bus and the task scratch for it.
+     */
+    int oversampling{1};
+    int oversamplingFromParam() const
+    {
+        return 1 << std::clamp((int)std::round(paramValue(pmOversampling)), 0, 2);
+    }
+    std::array<std::vector<float>, 2> oversampledBus;
+    StereoDecimator decimator;
+    void decimateBus(float **out, uint32_t chans, uint32_t frames);
+
+    // The thread pool tasks. Each has its own bank and scratch, sized in activate, and
+    // renders the active voices [index * voices_per_task, (index + 1) * voices_per_task)
+    static constexpr int thread_pool_min_voices = 32;
+    static constexpr int voices_per_task = 16;
+    struct RenderTask
+    {
+        SawDemoVoiceBank bank;
+        std::array<std::vector<float>, 2> scratch;
+    };
+    std::vector<RenderTask> renderTasks;
+    int renderTaskCount{0};
+    uint32_t renderTaskFrames{0};
+
+    // Our share of the internal worker pool, held from activate to deactivate when Internal
+    // Threads is on and the host has no pool of its own
+    std::shared_ptr<WorkerPool> workerPool;
+    WorkerPool::Job workerJob;
+    bool workerPoolWanted{false};
+    bool wantsWorkerPool() const
+    {
+        return paramValue(pmInternalThreads) > 0.5 && !_host.canUseThreadPool();
+    }
 };
 } // namespace sst::clap_saw_demo
 
@@ -0,0 +1,66 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_DENORMALS_H
+#define CLAP_SAW_DEMO_DENORMALS_H
+
+#include <cstdint>
+#include "simd-helpers.h"
+
+namespace sst::clap_saw_demo
+{
+/*
+ * ScopedFlushDenormals has the FPU treat denormal floats as zero for as long as it lives,
+ * and puts the caller's mode back when it goes. A filter decaying toward silence spends
+ * a long time in denormals, and on most CPUs every operation on one is many times slower
+ * than on a normal float.
+ *
+ * The mode is per thread, so anything rendering audio wants one: process, and each
+ * thread pool task. On x86 we set FTZ (flush results) and DAZ (read inputs as zero) in
+ * MXCSR, which covers SSE and AVX. On ARM the FZ bit in FPCR (FPSCR on 32 bit) does both.
+ * Elsewhere this does nothing and the filters' own flushing is all we have.
+ */
+struct ScopedFlushDenormals
+{
+#if CLAP_SAW_DEMO_SIMD_AVX || CLAP_SAW_DEMO_SIMD_SSE2
+    static constexpr uint32_t ftz_daz = 0x8040;
+    uint32_t saved{_mm_getcsr()};
+
+    ScopedFlushDenormals() { _mm_setcsr(saved | ftz_daz); }
+    ~ScopedFlushDenormals() { _mm_setcsr(saved); }
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+    static constexpr uint64_t fz = 1ULL << 24;
+    uint64_t saved{0};
+
+    ScopedFlushDenormals()
+    {
+        __asm__ __volatile__("mrs %0, fpcr" : "=r"(saved));
+        __asm__ __volatile__("msr fpcr, %0" : : "r"(saved | fz));
+    }
+    ~ScopedFlushDenormals() { __asm__ __volatile__("msr fpcr, %0" : : "r"(saved)); }
+#elif defined(__arm__) && defined(__ARM_FP) && (defined(__GNUC__) || defined(__clang__))
+    static constexpr uint32_t fz = 1U << 24;
+    uint32_t saved{0};
+
+    ScopedFlushDenormals()
+    {
+        __asm__ __volatile__("vmrs %0, fpscr" : "=r"(saved));
+        __asm__ __volatile__("vmsr fpscr, %0" : : "r"(saved | fz));
+    }
+    ~ScopedFlushDenormals() { __asm__ __volatile__("vmsr fpscr, %0" : : "r"(saved)); }
+#else
+    ScopedFlushDenormals() {}
+#endif
+
+    ScopedFlushDenormals(const ScopedFlushDenormals &) = delete;
+    ScopedFlushDenormals &operator=(const ScopedFlushDenormals &) = delete;
+};
+} // namespace sst::clap_saw_demo
+
+#endif // CLAP_SAW_DEMO_DENORMALS_H
@@ -0,0 +1,78 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_FAST_MATH_H
+#define CLAP_SAW_DEMO_FAST_MATH_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+/*
+ * The voice turns pitches into frequencies, and cutoffs into filter coefficients, every
+ * time a pitch or filter parameter moves. With a lot of modulation and bend that is a lot
+ * of pow and tan calls. These are cheaper polynomial and rational versions with a known
+ * error, and semitonesToRatio / prewarpTan are what the voice calls: the exact library
+ * functions normally, or the fast ones if you build with CLAP_SAW_DEMO_FAST_MATH (the
+ * cmake option of the same name).
+ */
+namespace sst::clap_saw_demo::dspmath
+{
+/*
+ * 2^x, to within 1e-12 relative for |x| < 1000. We take out the nearest integer power,
+ * which goes straight into the exponent bits, and the remaining 2^f with |f| <= 0.5 is a
+ * degree 10 series for e^(f ln 2).
+ */
+inline double fastPow2(double x)
+{
+    x = std::clamp(x, -1000.0, 1000.0);
+    auto n = std::floor(x + 0.5);
+    auto f = (x - n) * 0.69314718055994530942;
+
+    auto p = 1.0 / 3628800.0;
+    p = p * f + 1.0 / 362880.0;
+    p = p * f + 1.0 / 40320.0;
+    p = p * f + 1.0 / 5040.0;
+    p = p * f + 1.0 / 720.0;
+    p = p * f + 1.0 / 120.0;
+    p = p * f + 1.0 / 24.0;
+    p = p * f + 1.0 / 6.0;
+    p = p * f + 0.5;
+    p = p * f + 1.0;
+    p = p * f + 1.0;
+
+    auto bits = (uint64_t)((int64_t)n + 1023) << 52;
+    double scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+}
+
+/*
+ * tan(x) for 0 <= x <= 1.4 from its [5/4] Pade approximant, to within 3e-5 relative
+ * at the top of that range and far better below it. The filter asks for
+ * tan(pi * cutoff / sampleRate), and the 15kHz cutoff clamp keeps that under 1.1 at
+ * 44.1kHz and above.
+ */
+inline double fastTan(double x)
+{
+    auto x2 = x * x;
+    return x * (945.0 + x2 * (-105.0 + x2)) / (945.0 + x2 * (-420.0 + 15.0 * x2));
+}
+
+#if CLAP_SAW_DEMO_FAST_MATH
+inline double semitonesToRatio(double s) { return fastPow2(s / 12.0); }
+inline double prewarpTan(double x) { return fastTan(x); }
+#else
+inline double semitonesToRatio(double s) { return std::pow(2.0, s / 12.0); }
+inline double prewarpTan(double x) { return std::tan(x); }
+#endif
+} // namespace sst::clap_saw_demo::dspmath
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#include "halfband-decimator.h"
+#include "simd-helpers.h"
+#include <algorithm>
+#include <cmath>
+
+namespace sst::clap_saw_demo
+{
+namespace
+{
+// About 80dB of stopband for the Kaiser window
+constexpr double kaiser_beta = 7.86;
+constexpr double pi = 3.14159265358979323846;
+
+// The zeroth order modified Bessel function, for the Kaiser window
+double besselI0(double x)
+{
+    double sum{1.0}, term{1.0};
+    for (int k = 1; k < 50 && term > 1e-12 * sum; ++k)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+} // namespace
+
+void HalfbandDecimator::setup(int halfTaps, int maxOut)
+{
+    this->halfTaps = halfTaps;
+
+    // Tap 2j + 1 either side of the centre is a sinc at half band, (-1)^j / (pi (2j + 1)),
+    // under the window. We then scale them so the filter passes DC at unity.
+    auto half = 2.0 * halfTaps - 1;
+    std::vector<double> h(halfTaps);
+    double sum{0};
+    for (int j = 0; j < halfTaps; ++j)
+    {
+        auto n = 2.0 * j + 1;
+        auto w = besselI0(kaiser_beta * std::sqrt(1.0 - (n / half) * (n / half))) /
+                 besselI0(kaiser_beta);
+        h[j] = (j % 2 ? -1.0 : 1.0) / (pi * n) * w;
+        sum += h[j];
+    }
+    coeffs.resize(halfTaps);
+    for (int j = 0; j < halfTaps; ++j)
+        coeffs[j] = h[j] * 0.25 / sum;
+
+    even.assign(2 * halfTaps - 1 + maxOut, 0.f);
+    odd.assign(halfTaps + maxOut, 0.f);
+}
+
+void HalfbandDecimator::reset()
+{
+    std::fill(even.begin(), even.end(), 0.f);
+    std::fill(odd.begin(), odd.end(), 0.f);
+}
+
+/*
+ * With K = halfTaps, output m is
+ *
+ *   1/2 odd[m - K] + sum over j < K of coeffs[j] * (even[m - K - j] + even[m - K + 1 + j])
+ *
+ * counting phases from the start of the block. Our buffers keep 2K - 1 even samples and
+ * K odd ones of history in front of the block, so for the outputs m to m + float_lanes
+ * every term is a contiguous load.
+ */
+void HalfbandDecimator::process(const float *in, float *out, int n)
+{
+    using namespace simd;
+    if (n <= 0)
+        return;
+
+    const int K = halfTaps, evenHistory = 2 * K - 1, oddHistory = K;
+    float *E = even.data(), *O = odd.data();
+    for (int i = 0; i < n; ++i)
+    {
+        E[evenHistory + i] = in[2 * i];
+        O[oddHistory + i] = in[2 * i + 1];
+    }
+
+    const auto vhalf = set1f(0.5f);
+    int m = 0;
+    for (; m + float_lanes <= n; m += float_lanes)
+    {
+        auto acc = mulf(vhalf, loadf(O + m));
+        for (int j = 0; j < K; ++j)
+        {
+            auto pair = addf(loadf(E + m + K - 1 - j), loadf(E + m + K + j));
+            acc = addf(acc, mulf(set1f(coeffs[j]), pair));
+        }
+        storef(out + m, acc);
+    }
+    for (; m < n; ++m)
+    {
+        auto acc = 0.5f * O[m];
+        for (int j = 0; j < K; ++j)
+            acc += coeffs[j] * (E[m + K - 1 - j] + E[m + K + j]);
+        out[m] = acc;
+    }
+
+    std::copy(E + n, E + n + evenHistory, E);
+    std::copy(O + n, O + n + oddHistory, O);
+}
+
+void StereoDecimator::setup(int factor, int maxOutFrames)
+{
+    this->factor = factor;
+    for (int c = 0; c < 2; ++c)
+    {
+        if (factor == 4)
+        {
+            stages[0][c].setup(6, 2 * maxOutFrames);
+            stages[1][c].setup(16, maxOutFrames);
+        }
+        else
+        {
+            stages[0][c].setup(16, maxOutFrames);
+        }
+    }
+}
+
+double StereoDecimator::delay() const
+{
+    if (factor == 4)
+        return stages[0][0].delay() / 2 + stages[1][0].delay();
+    if (factor == 2)
+        return stages[0][0].delay();
+    return 0;
+}
+
+void StereoDecimator::reset()
+{
+    for (auto &s : stages)
+        for (auto &c : s)
+            c.reset();
+}
+
+void StereoDecimator::process(float *inL, float *inR, float *outL, float *outR, int n)
+{
+    if (factor == 4)
+    {
+        stages[0][0].process(inL, inL, 2 * n);
+        stages[0][1].process(inR, inR, 2 * n);
+        stages[1][0].process(inL, outL, n);
+        stages[1][1].process(inR, outR, n);
+    }
+    else if (factor == 2)
+    {
+        stages[0][0].process(inL, outL, n);
+        stages[0][1].process(inR, outR, n);
+    }
+}
+} // namespace sst::clap_saw_demo
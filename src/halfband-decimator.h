@@ -0,0 +1,71 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_HALFBAND_DECIMATOR_H
+#define CLAP_SAW_DEMO_HALFBAND_DECIMATOR_H
+
+#include <vector>
+
+namespace sst::clap_saw_demo
+{
+/*
+ * HalfbandDecimator halves the sample rate of one channel through a linear phase halfband
+ * FIR, a Kaiser windowed lowpass at a quarter of the input rate. Every other tap of a
+ * halfband is zero apart from the centre, which is 1/2. Split polyphase, the odd input
+ * samples only meet the centre tap and the even ones meet the rest, which are symmetric,
+ * so an output costs one multiply for the centre and one per pair of taps. We vectorize
+ * across outputs, so each SIMD op works on float_lanes of them.
+ *
+ * The filter is 4 * halfTaps - 1 long. setup allocates, so call it from activate.
+ */
+struct HalfbandDecimator
+{
+    void setup(int halfTaps, int maxOut);
+    void reset();
+
+    // Reads 2 * n samples from in and writes n to out, which may be in
+    void process(const float *in, float *out, int n);
+
+    // The group delay, in output samples. Half the filter length at the input rate.
+    double delay() const { return (2 * halfTaps - 1) / 2.0; }
+
+  private:
+    int halfTaps{0};
+    std::vector<float> coeffs;
+
+    // The even and odd phases of the input: the history the taps reach back into, then
+    // this block's samples
+    std::vector<float> even, odd;
+};
+
+/*
+ * StereoDecimator takes a stereo bus oversampled by 2 or 4 back to the base rate, with one
+ * halfband for 2x and two in cascade for 4x. The first of the two only has to keep the
+ * images above the base rate's band out of the second's, so it can be a lot shorter.
+ */
+struct StereoDecimator
+{
+    void setup(int factor, int maxOutFrames);
+    void reset();
+
+    // Reads factor * n frames from inL and inR, which it may use as scratch, and writes n
+    // to outL and outR
+    void process(float *inL, float *inR, float *outL, float *outR, int n);
+
+    // The group delay through every stage, in output samples
+    double delay() const;
+
+    int factor{1};
+
+  private:
+    HalfbandDecimator stages[2][2]; // [stage][channel]
+};
+} // namespace sst::clap_saw_demo
+
+#endif // CLAP_SAW_DEMO_HALFBAND_DECIMATOR_H
@@ -0,0 +1,116 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_PARAM_TABLE_H
+#define CLAP_SAW_DEMO_PARAM_TABLE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace sst::clap_saw_demo
+{
+/*
+ * ParamDesc is one row of a parameter table: everything clap_param_info needs, plus
+ * how to show the value to a user. The table's order is the CLAP parameter index and
+ * the position of the value in the engine's value array.
+ */
+struct ParamDesc
+{
+    enum Display
+    {
+        NUMBER,  // the value as is
+        SECONDS, // a 0-1 time parameter, shown in seconds
+        CENTS,
+        SEMITONES,
+        HZ,      // a 12-TET MIDI key, shown as a frequency
+        VOICES,  // an integer count of voices
+        CHOICE   // a stepped index into choices
+    };
+
+    uint32_t id;
+    const char *name;
+    const char *module;
+    double min, max, def;
+    uint32_t flags;
+    Display display;
+    const char *const *choices; // max - min + 1 names, for CHOICE
+
+    // A bitmask, defined by the table's owner, of the state which depends on this param
+    uint32_t groups;
+};
+
+/*
+ * ParamHash maps our sparse parameter ids to their table index. It is a perfect hash,
+ * found at compile time by makeParamHash: multiply by 'mul', keep the top 'bits' bits,
+ * and no two ids land in the same bucket. So a lookup is one multiply, one shift, and
+ * one compare to reject ids which aren't ours.
+ */
+template <size_t N> struct ParamHash
+{
+    static constexpr int bits = N <= 4 ? 4 : N <= 16 ? 6 : N <= 64 ? 8 : 10;
+    static constexpr uint32_t buckets = 1U << bits;
+    static_assert(N * 4 <= buckets, "Grow ParamHash::bits for a table this size");
+
+    uint32_t mul{0};
+    std::array<uint32_t, N> ids{};
+    std::array<int16_t, buckets> index{};
+
+    static constexpr uint32_t bucket(uint32_t id, uint32_t mul)
+    {
+        return (uint32_t)(id * mul) >> (32 - bits);
+    }
+
+    constexpr int indexOf(uint32_t id) const
+    {
+        auto i = index[bucket(id, mul)];
+        return (i >= 0 && ids[i] == id) ? i : -1;
+    }
+
+    constexpr bool isPerfect() const { return mul != 0; }
+};
+
+template <size_t N> constexpr ParamHash<N> makeParamHash(const std::array<ParamDesc, N> &descs)
+{
+    using hash_t = ParamHash<N>;
+    hash_t res{};
+    for (size_t i = 0; i < N; ++i)
+        res.ids[i] = descs[i].id;
+
+    // Try odd multipliers from a xorshift sequence until one is collision free. With the
+    // table at most a quarter full that takes a handful of goes.
+    uint32_t x{0x9E3779B9U};
+    for (int attempt = 0; attempt < 4096; ++attempt)
+    {
+        auto mul = x | 1;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+
+        for (auto &b : res.index)
+            b = -1;
+
+        bool ok{true};
+        for (size_t i = 0; i < N && ok; ++i)
+        {
+            auto b = hash_t::bucket(res.ids[i], mul);
+            ok = res.index[b] < 0;
+            res.index[b] = (int16_t)i;
+        }
+        if (ok)
+        {
+            res.mul = mul;
+            return res;
+        }
+    }
+    return res;
+}
+} // namespace sst::clap_saw_demo
+
+#endif // CLAP_SAW_DEMO_PARAM_TABLE_H
@@ -0,0 +1,369 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#include "saw-voice-bank.h"
+#include <algorithm>
+
+/*
+ * This is the same DSP as saw-voice.cpp, just turned sideways so each SIMD lane is a voice.
+ * If you are reading to learn the synth, read that file first.
+ */
+
+namespace sst::clap_saw_demo
+{
+void SawDemoVoiceBank::gather(SawDemoVoice *const *voices, int n)
+{
+    nVoices = n;
+    nUnison = 0;
+    stateful = true;
+    for (int l = 0; l < n; ++l)
+    {
+        nUnison = std::max(nUnison, voices[l]->unison);
+        stateful = stateful && voices[l]->statefulDPW;
+    }
+
+    for (int l = 0; l < bank_lanes; ++l)
+    {
+        for (int u = 0; u < nUnison; ++u)
+        {
+            phase[u][l] = 0.0;
+            dPhase[u][l] = 0.0;
+            scale[u][l] = 0.0;
+            gainL[u][l] = 0.0;
+            gainR[u][l] = 0.0;
+            dpwPrev1[u][l] = 0.0;
+            dpwPrev2[u][l] = 0.0;
+        }
+
+        for (int c = 0; c < 2; ++c)
+        {
+            ic1eq[c][l] = 0.f;
+            ic2eq[c][l] = 0.f;
+        }
+        a1[l] = a2[l] = a3[l] = ak[l] = 0.f;
+        mixLow[l] = mixBand[l] = mixHigh[l] = 0.f;
+        glideLeft[l] = 0;
+    }
+
+    for (int l = 0; l < n; ++l)
+    {
+        auto &v = *voices[l];
+        for (int u = 0; u < v.unison; ++u)
+        {
+            phase[u][l] = v.phase[u];
+            dPhase[u][l] = v.dPhase[u];
+            scale[u][l] = 0.25 / 6.0 * (v.dPhaseInv[u] * v.dPhaseInv[u]);
+            gainL[u][l] = v.gainL[u];
+            gainR[u][l] = v.gainR[u];
+
+            if (stateful && v.dpwSeeded)
+            {
+                dpwPrev1[u][l] = v.dpwPrev1[u];
+                dpwPrev2[u][l] = v.dpwPrev2[u];
+            }
+            else if (stateful)
+            {
+                // Seeded from the phase, as the voice's kernel would
+                auto x0 = v.phase[u] * 2 - 1, dx = v.dPhase[u] * 2;
+                auto x1 = x0 - dx, x2 = x1 - dx;
+                dpwPrev1[u][l] = (x1 * x1 - 1) * x1;
+                dpwPrev2[u][l] = (x2 * x2 - 1) * x2;
+            }
+        }
+
+        const auto &f = v.filter;
+        for (int c = 0; c < 2; ++c)
+        {
+            ic1eq[c][l] = f.ic1eq[c];
+            ic2eq[c][l] = f.ic2eq[c];
+        }
+        loadFilterCoeff(l, f);
+        glideLeft[l] = f.glideLeft;
+    }
+}
+
+// The coefficients of lane l's filter, with its mode folded into the mix
+void SawDemoVoiceBank::loadFilterCoeff(int l, const SawDemoVoice::StereoSimperSVF &f)
+{
+    mixLow[l] = mixBand[l] = mixHigh[l] = 0.f;
+    a1[l] = f.a1;
+    a2[l] = f.a2;
+    a3[l] = f.a3;
+    ak[l] = f.ak;
+
+    // low is v2, band is v1, high is v0 in the filter kernel below
+    switch (f.mode)
+    {
+    case SawDemoVoice::StereoSimperSVF::LP:
+        mixLow[l] = 1.f;
+        break;
+    case SawDemoVoice::StereoSimperSVF::BP:
+        mixBand[l] = 1.f;
+        break;
+    case SawDemoVoice::StereoSimperSVF::HP:
+        mixHigh[l] = 1.f;
+        break;
+    case SawDemoVoice::StereoSimperSVF::NOTCH:
+        mixLow[l] = 1.f;
+        mixHigh[l] = 1.f;
+        break;
+    case SawDemoVoice::StereoSimperSVF::PEAK:
+        mixLow[l] = 1.f;
+        mixHigh[l] = -1.f;
+        break;
+    case SawDemoVoice::StereoSimperSVF::ALL:
+        mixLow[l] = 1.f;
+        mixBand[l] = -f.k;
+        mixHigh[l] = 1.f;
+        break;
+    }
+}
+
+// As StereoSimperSVF::flushDenormals, for every lane
+void SawDemoVoiceBank::flushDenormals()
+{
+    using namespace simd;
+    const auto floor = set1f(SawDemoVoice::StereoSimperSVF::denormal_floor);
+    for (int c = 0; c < 2; ++c)
+    {
+        for (int o = 0; o < bank_lanes; o += float_lanes)
+        {
+            storef(&ic1eq[c][o], flushBelowf(loadf(&ic1eq[c][o]), floor));
+            storef(&ic2eq[c][o], flushBelowf(loadf(&ic2eq[c][o]), floor));
+        }
+    }
+}
+
+void SawDemoVoiceBank::scatter(SawDemoVoice *const *voices, int n)
+{
+    for (int l = 0; l < n; ++l)
+    {
+        auto &v = *voices[l];
+        for (int u = 0; u < v.unison; ++u)
+        {
+            v.phase[u] = phase[u][l];
+            if (stateful)
+            {
+                v.dpwPrev1[u] = dpwPrev1[u][l];
+                v.dpwPrev2[u] = dpwPrev2[u][l];
+            }
+        }
+
+        for (int c = 0; c < 2; ++c)
+        {
+            v.filter.ic1eq[c] = ic1eq[c][l];
+            v.filter.ic2eq[c] = ic2eq[c][l];
+        }
+
+        // The direct differentiator moved the phase without the voice's history
+        v.dpwSeeded = stateful;
+    }
+}
+
+void SawDemoVoiceBank::renderBlock(SawDemoVoice *const *voices, int n, float *L, float *R,
+                                   int nframes)
+{
+    gather(voices, n);
+
+    /*
+     * We go a chunk at a time, and like SawDemoVoice::renderBlock a chunk never crosses a
+     * control tick. The engine lines its voices' ticks up, so in practice they all tick
+     * together. At a tick a lane may start a filter glide, and then the voices fill their
+     * envelope ramps for the chunk, which leaves the state machine out of the sample loop.
+     */
+    int done = 0;
+    while (done < nframes)
+    {
+        auto chunk = std::min(SawDemoVoice::block_chunk, nframes - done);
+        for (int l = 0; l < n; ++l)
+        {
+            auto &v = *voices[l];
+            if (!v.isPlaying())
+                continue;
+            if (v.tickLeft <= 0)
+            {
+                v.controlTick();
+                loadFilterCoeff(l, v.filter);
+                glideLeft[l] = v.filter.glideLeft;
+            }
+            chunk = std::min(chunk, v.tickLeft);
+        }
+
+        int sounding{0};
+        for (int l = 0; l < bank_lanes; ++l)
+        {
+            envLen[l] = 0;
+            if (l < n && voices[l]->isPlaying())
+            {
+                envLen[l] = voices[l]->renderEnvelope(envGain[l], chunk);
+                voices[l]->tickLeft -= chunk;
+            }
+            sounding = std::max(sounding, envLen[l]);
+        }
+        if (sounding == 0)
+            break;
+
+        if (stateful)
+            renderChunk<true>(voices, L + done, R + done, sounding);
+        else
+            renderChunk<false>(voices, L + done, R + done, sounding);
+        flushDenormals();
+        for (int l = 0; l < n; ++l)
+            if (envLen[l] > 0)
+                voices[l]->trackSilence(peak[l], envLen[l]);
+        done += chunk;
+    }
+
+    scatter(voices, n);
+}
+
+template <bool Stateful>
+void SawDemoVoiceBank::renderChunk(SawDemoVoice *const *voices, float *L, float *R,
+                                   int nframes)
+{
+    using namespace simd;
+    static constexpr int nd = bank_lanes / double_lanes;
+    static constexpr int nf = bank_lanes / float_lanes;
+
+    const auto oned = set1d(1.0), twod = set1d(2.0);
+    const auto twof = set1f(2.f);
+    auto cubic = [oned](vdouble x) { return muld(subd(muld(x, x), oned), x); };
+
+    /*
+     * The voices worked out the envelope already. We lay it out by sample for the loop
+     * below, with a lane which reached NEWLY_OFF earlier in the chunk silenced from there,
+     * exactly as the per voice engine stops rendering it. And we note which lanes have a
+     * filter glide to step, which is usually none of them.
+     */
+    int gliding[bank_lanes], nGliding{0};
+    for (int l = 0; l < bank_lanes; ++l)
+    {
+        peak[l] = simd::peakf(envGain[l], envLen[l]);
+        for (int s = 0; s < nframes; ++s)
+        {
+            auto on = s < envLen[l];
+            laneGain[s][l] = on ? envGain[l][s] : 0.f;
+            laneLive[s][l] = on ? 1.f : 0.f;
+        }
+        if (envLen[l] > 0 && glideLeft[l] > 0)
+            gliding[nGliding++] = l;
+    }
+
+    alignas(32) double sumL[bank_lanes], sumR[bank_lanes];
+    alignas(32) float in[2][bank_lanes];
+    for (int s = 0; s < nframes; ++s)
+    {
+        // A gliding filter steps the voice's own coefficients, so the voice is where it
+        // should be when we hand it back
+        for (int g = 0; g < nGliding; ++g)
+        {
+            auto l = gliding[g];
+            if (s < envLen[l] && glideLeft[l] > 0)
+            {
+                auto &f = voices[l]->filter;
+                f.advanceGlide();
+                loadFilterCoeff(l, f);
+                glideLeft[l] = f.glideLeft;
+            }
+        }
+
+        // The DPW saw of saw-voice.cpp, with the voices across the register
+        for (int k = 0; k < nd; ++k)
+        {
+            auto o = k * double_lanes;
+            auto aL = set1d(0.0), aR = set1d(0.0);
+            for (int u = 0; u < nUnison; ++u)
+            {
+                auto ph = loadd(&phase[u][o]);
+                auto dp = loadd(&dPhase[u][o]);
+
+                auto x0 = subd(muld(ph, twod), oned);
+                auto c0 = cubic(x0);
+
+                vdouble saw;
+                if constexpr (Stateful)
+                {
+                    auto c1 = loadd(&dpwPrev1[u][o]), c2 = loadd(&dpwPrev2[u][o]);
+                    saw = muld(subd(addd(c0, c2), muld(twod, c1)), loadd(&scale[u][o]));
+                    c2 = c1;
+                    c1 = c0;
+
+                    // As in the voice, a wrap puts the history a cycle out, so we evaluate
+                    // it again from the new phase
+                    bool wrapped;
+                    ph = wrapd(addd(ph, dp), wrapped);
+                    if (wrapped)
+                    {
+                        auto dx = muld(dp, twod);
+                        auto xn = subd(subd(muld(ph, twod), oned), dx);
+                        c1 = cubic(xn);
+                        c2 = cubic(subd(xn, dx));
+                    }
+                    stored(&dpwPrev1[u][o], c1);
+                    stored(&dpwPrev2[u][o], c2);
+                }
+                else
+                {
+                    auto dx = muld(dp, twod);
+                    auto x1 = subd(x0, dx);
+                    auto x2 = subd(x1, dx);
+                    saw = muld(subd(addd(c0, cubic(x2)), muld(twod, cubic(x1))),
+                               loadd(&scale[u][o]));
+                    ph = wrapd(addd(ph, dp));
+                }
+                aL = addd(aL, muld(loadd(&gainL[u][o]), saw));
+                aR = addd(aR, muld(loadd(&gainR[u][o]), saw));
+
+                stored(&phase[u][o], ph);
+            }
+            stored(&sumL[o], aL);
+            stored(&sumR[o], aR);
+        }
+
+        const float *AR = laneGain[s];
+        for (int l = 0; l < bank_lanes; ++l)
+        {
+            in[0][l] = AR[l] * sumL[l];
+            in[1][l] = AR[l] * sumR[l];
+        }
+
+        // And the StereoSimperSVF, with the mode folded into the mix coefficients
+        const float *live = laneLive[s];
+        float out[2]{0.f, 0.f};
+        for (int c = 0; c < 2; ++c)
+        {
+            auto acc = set1f(0.f);
+            for (int k = 0; k < nf; ++k)
+            {
+                auto o = k * float_lanes;
+                auto i1 = loadf(&ic1eq[c][o]), i2 = loadf(&ic2eq[c][o]);
+                auto fa1 = loadf(&a1[o]), fa2 = loadf(&a2[o]);
+
+                auto v3 = subf(loadf(&in[c][o]), i2);
+                auto v0 = subf(mulf(fa1, v3), mulf(loadf(&ak[o]), i1));
+                auto v1 = addf(mulf(fa2, v3), mulf(fa1, i1));
+                auto v2 = addf(addf(mulf(loadf(&a3[o]), v3), mulf(fa2, i1)), i2);
+
+                storef(&ic1eq[c][o], subf(mulf(twof, v1), i1));
+                storef(&ic2eq[c][o], subf(mulf(twof, v2), i2));
+
+                auto res = addf(addf(mulf(loadf(&mixLow[o]), v2), mulf(loadf(&mixBand[o]), v1)),
+                                mulf(loadf(&mixHigh[o]), v0));
+                res = mulf(loadf(&live[o]), res);
+                storef(&peak[o], maxf(loadf(&peak[o]), absf(res)));
+                acc = addf(acc, res);
+            }
+            out[c] = hsumf(acc);
+        }
+
+        L[s] += out[0];
+        R[s] += out[1];
+    }
+}
+} // namespace sst::clap_saw_demo
@@ -0,0 +1,91 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_VOICE_BANK_H
+#define CLAP_SAW_DEMO_VOICE_BANK_H
+
+#include "saw-voice.h"
+#include "simd-helpers.h"
+
+namespace sst::clap_saw_demo
+{
+/*
+ * SawDemoVoiceBank is the voice-parallel alternative to calling SawDemoVoice::renderBlock
+ * voice by voice. Vectorizing inside a voice only fills a register when there is enough
+ * unison; the bank instead fills the register with voices. It copies the oscillator and
+ * filter state of a group of up to bank_lanes voices into a structure-of-arrays block where
+ * each lane is one voice, advances the whole group in lock-step, and copies the state back.
+ * The envelopes stay with the voices: each control tick a voice hands the bank its gain
+ * ramp for the chunk up to its next tick, and the bank runs the lanes to the shortest one.
+ *
+ * The oscillators use the same differentiator as the voices: the stateful one, carrying
+ * each voice's history in and out, when every voice in the group has statefulDPW on, as
+ * they do in the engine, and the direct one otherwise. So the engine choice changes only
+ * the speed, and the output agrees with per voice rendering to rounding.
+ *
+ * The voices stay the owners of their state, and the bank is just a different way to run
+ * them, so the engine can switch between the two at any block boundary.
+ */
+struct SawDemoVoiceBank
+{
+    static constexpr int bank_lanes = simd::float_lanes > 4 ? simd::float_lanes : 4;
+
+    // Accumulates n (<= bank_lanes) playing voices into L and R with the same semantics
+    // as calling SawDemoVoice::renderBlock on each
+    void renderBlock(SawDemoVoice *const *voices, int n, float *L, float *R, int nframes);
+
+  private:
+    void gather(SawDemoVoice *const *voices, int n);
+    void scatter(SawDemoVoice *const *voices, int n);
+    void loadFilterCoeff(int l, const SawDemoVoice::StereoSimperSVF &f);
+    template <bool Stateful>
+    void renderChunk(SawDemoVoice *const *voices, float *L, float *R, int nframes);
+    void flushDenormals();
+
+    int nVoices{0}, nUnison{0};
+    bool stateful{false};
+
+    // Oscillators, indexed [unison][voice]. Voices with less unison than the widest in the
+    // group have zero gain and zero increment in the extra rows.
+    alignas(32) double phase[SawDemoVoice::max_uni][bank_lanes];
+    alignas(32) double dPhase[SawDemoVoice::max_uni][bank_lanes];
+    alignas(32) double scale[SawDemoVoice::max_uni][bank_lanes];
+    alignas(32) double gainL[SawDemoVoice::max_uni][bank_lanes];
+    alignas(32) double gainR[SawDemoVoice::max_uni][bank_lanes];
+
+    // The stateful differentiator's cubic at the last two samples, as in the voice
+    alignas(32) double dpwPrev1[SawDemoVoice::max_uni][bank_lanes];
+    alignas(32) double dpwPrev2[SawDemoVoice::max_uni][bank_lanes];
+
+    // Filter state and coefficients. Every filter mode is a blend of the low, band
+    // and high outputs, so the mode becomes three more coefficients per lane.
+    alignas(32) float ic1eq[2][bank_lanes], ic2eq[2][bank_lanes];
+    alignas(32) float a1[bank_lanes], a2[bank_lanes], a3[bank_lanes], ak[bank_lanes];
+    alignas(32) float mixLow[bank_lanes], mixBand[bank_lanes], mixHigh[bank_lanes];
+
+    // Samples left in each lane's filter glide. The glide itself steps in the voice.
+    int glideLeft[bank_lanes];
+
+    // Each lane's envelope gain for the chunk, from its voice, and how many samples of it
+    // the voice sounds for
+    alignas(32) float envGain[bank_lanes][SawDemoVoice::block_chunk];
+    int envLen[bank_lanes];
+
+    // The same gain laid out by sample, zero once a lane's voice has ended, and a mask
+    // which is 1 while it sounds. renderChunk fills these once so the sample loop has
+    // no per lane checks.
+    alignas(32) float laneGain[SawDemoVoice::block_chunk][bank_lanes];
+    alignas(32) float laneLive[SawDemoVoice::block_chunk][bank_lanes];
+
+    // The peak of each lane's gain and output over the chunk, for its voice's silence
+    // detector
+    alignas(32) float peak[bank_lanes];
+};
+} // namespace sst::clap_saw_demo
+#endif
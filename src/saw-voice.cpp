@@ -8,6 +8,8 @@
  */
 
 #include "saw-voice.h"
+#include "simd-helpers.h"
+#include "fast-math.h"
 #include <cmath>
 #include <algorithm>
 
@@ -24,88 +26,410 @@ float pival =
 
 void SawDemoVoice::recalcPitch()
 {
-    baseFreq = 440.0 * pow(2.0, ((key + pitchNoteExpressionValue + pitchBendWheel +
-                                  (oscDetune + oscDetuneMod) / 100) -
-                                 69.0) /
-                                    12.0);
+    auto detuneMod = oscDetuneMod + (monoMod ? monoMod->oscDetuneMod : 0.f);
+    auto spreadMod = uniSpreadMod + (monoMod ? monoMod->uniSpreadMod : 0.f);
+
+    baseFreq = 440.0 * dspmath::semitonesToRatio((key + pitchNoteExpressionValue + pitchBendWheel +
+                                                  (oscDetune + detuneMod) / 100) -
+                                                 69.0);
 
     for (int i = 0; i < unison; ++i)
     {
-        dPhase[i] =
-            (baseFreq * pow(2.0, (uniSpread + uniSpreadMod) * unitShift[i] / 100.0 / 12.0)) /
-            sampleRate;
+        dPhase[i] = (baseFreq * dspmath::semitonesToRatio((uniSpread + spreadMod) *
+                                                          unitShift[i] / 100.0)) /
+                    sampleRate;
         dPhaseInv[i] = 1.0 / dPhase[i];
     }
+
+    // The stateful differentiator's history was spaced by the old increment
+    dpwSeeded = false;
+
+    if (wavetable)
+        for (int i = 0; i < unison; ++i)
+            wtTable[i] = SawWavetable::tableFor(dPhase[i]);
 }
 
 void SawDemoVoice::recalcFilter()
 {
-    auto co = cutoff + cutoffMod;
-    auto rm = res + resMod;
+    // Gliding only makes sense from a filter which is running in the same mode
+    if (filterGlide > 0 && isPlaying() && filterMode == filter.mode)
+    {
+        filterPending = true;
+        return;
+    }
+    jumpFilter();
+}
 
+void SawDemoVoice::jumpFilter()
+{
     auto newfm = (StereoSimperSVF::Mode)filterMode;
 
     if (newfm != filter.mode)
         filter.init();
-    filter.mode = newfm;
-    filter.setCoeff(co, rm, srInv);
+    filter.setMode(newfm);
+    filter.glideLeft = 0;
+    filterPending = false;
+    filterCoeffFor(filter);
+}
+
+void SawDemoVoice::updateFilterGlide()
+{
+    if (!filterPending || filter.glideLeft > 0)
+        return;
+
+    filterPending = false;
+    StereoSimperSVF to;
+    filterCoeffFor(to);
+    filter.glideTo(to, filterGlide);
+}
+
+// Sets f's coefficients for our filter params and modulation
+void SawDemoVoice::filterCoeffFor(StereoSimperSVF &f) const
+{
+    if (monoMod && monoMod->sharesFilterWith(*this))
+    {
+        f.copyCoeff(monoMod->filter);
+        return;
+    }
+
+    auto co = cutoff + cutoffMod + (monoMod ? monoMod->cutoffMod : 0.f);
+    auto rm = res + resMod + (monoMod ? monoMod->resMod : 0.f);
+    f.setCoeff(co, rm, srInv);
+}
+
+void SawDemoVoice::MonoModulation::recalcFilter()
+{
+    srInv = 1.0 / sampleRate;
+    filter.setMode((StereoSimperSVF::Mode)filterMode);
+    filter.setCoeff(cutoff + cutoffMod, res + resMod, srInv);
+    filterCutoffMod = cutoffMod;
+    filterResMod = resMod;
+}
+
+// A voice sounds like our filter if it has no filter modulation of its own, its params
+// are the ones we computed for, and the mono mods haven't moved since
+bool SawDemoVoice::MonoModulation::sharesFilterWith(const SawDemoVoice &v) const
+{
+    return v.cutoffMod == 0 && v.resMod == 0 && v.cutoff == cutoff && v.res == res &&
+           v.filterMode == filterMode && v.srInv == srInv && filterCutoffMod == cutoffMod &&
+           filterResMod == resMod;
 }
 
 void SawDemoVoice::step()
 {
-    float AR = 1.0;
+    L = 0;
+    R = 0;
+    renderBlock(&L, &R, 1);
+}
+
+/*
+ * renderBlock runs the voice a chunk at a time, and a chunk never crosses a control tick.
+ * The envelope fills a gain ramp for the chunk, the oscillators render it into an
+ * interleaved stereo buffer, the filter kernel for our mode runs over it in place, and we
+ * accumulate the result straight into the caller's buffers. The silence detector gets the
+ * peak of the gain and of the output.
+ */
+void SawDemoVoice::renderBlock(float *outL, float *outR, int nframes)
+{
+    float buf[2 * block_chunk], gain[block_chunk];
 
-    if (state == ATTACK)
+    int done = 0;
+    while (done < nframes && isPlaying())
     {
-        AR = time / ampAttack;
-        releaseFrom = AR;
-        time += srInv;
-        if (time >= ampAttack)
+        if (tickLeft <= 0)
+            controlTick();
+
+        auto n = std::min({block_chunk, nframes - done, tickLeft});
+        n = renderEnvelope(gain, n);
+        (this->*renderOscFn)(buf, gain, n);
+        filter.processFn(filter, buf, n);
+        filter.flushDenormals();
+
+        for (int i = 0; i < n; ++i)
         {
-            state = HOLD;
+            outL[done + i] += buf[2 * i];
+            outR[done + i] += buf[2 * i + 1];
         }
+        trackSilence(std::max(simd::peakf(gain, n), simd::peakf(buf, 2 * n)), n);
+        tickLeft -= n;
+        done += n;
+    }
+}
+
+void SawDemoVoice::trackSilence(float peak, int n)
+{
+    quietFor = peak < silence_threshold ? quietFor + n : 0;
+    if (state == RELEASING && quietFor >= silence_hold)
+        state = NEWLY_OFF;
+}
+
+void SawDemoVoice::controlTick()
+{
+    updateFilterGlide();
+    tickLeft = controlRate();
+}
+
+// The number of samples a segment of this length lasts: the first at which the time
+// since its start reaches the length. We compare that time as a float, as the per sample
+// envelope did, so a length which rounds to a whole number of samples ends on it.
+int SawDemoVoice::samplesIn(float seconds) const
+{
+    auto n = std::max(1, (int)std::ceil(seconds / srInv));
+    if (n > 1 && (float)((n - 1) * srInv) >= seconds)
+        n--;
+    return n;
+}
+
+namespace
+{
+// Where an exponential segment gets to, as a ratio, before the offset which lands it on
+// its end level: the attack bends like a charging capacitor, and the release has decayed
+// by 60dB when it steps to 0
+constexpr double expAttackRatio = 0.2, expReleaseRatio = 0.001;
+} // namespace
 
-        if (ampGate)
-            AR = 1.0;
+/*
+ * Fills gain[i] with ramp.at(pos + i) * vca for i in [0, n). We work out where the piece
+ * starts once, in double. After that a linear ramp is a multiply-add off the sample index
+ * and an exponential one is a single multiply per vector of samples.
+ */
+void SawDemoVoice::fillRamp(float *gain, int n, const EnvRamp &ramp, int pos, double vca)
+{
+    using namespace simd;
+    alignas(32) float lanes[float_lanes];
+    int i = 0;
+
+    if (ramp.r > 0)
+    {
+        const float a = ramp.a * vca;
+        double b = ramp.b * vca * std::pow(ramp.r, pos), rv{1.0};
+        for (int l = 0; l < float_lanes; ++l)
+        {
+            lanes[l] = b * rv;
+            rv *= ramp.r;
+        }
+        auto va = set1f(a), vb = loadf(lanes), vr = set1f(rv);
+        for (; i + float_lanes <= n; i += float_lanes)
+        {
+            storef(gain + i, addf(va, vb));
+            vb = mulf(vb, vr);
+        }
+        for (b *= std::pow(ramp.r, i); i < n; ++i)
+        {
+            gain[i] = a + b;
+            b *= ramp.r;
+        }
+        return;
+    }
+
+    const float base = ramp.at(pos) * vca, slope = ramp.b * vca;
+    for (int l = 0; l < float_lanes; ++l)
+        lanes[l] = l;
+    auto vbase = set1f(base), vslope = set1f(slope), vi = loadf(lanes);
+    auto vstep = set1f(float_lanes);
+    for (; i + float_lanes <= n; i += float_lanes)
+    {
+        storef(gain + i, addf(vbase, mulf(vslope, vi)));
+        vi = addf(vi, vstep);
+    }
+    for (; i < n; ++i)
+        gain[i] = base + slope * i;
+}
+
+SawDemoVoice::EnvRamp SawDemoVoice::envelopeRamp() const
+{
+    EnvRamp res;
+    if (state == ATTACK && ampCurve == AEG_EXPONENTIAL)
+    {
+        auto top = 1.0 / (1.0 - expAttackRatio);
+        res = {top, -top, std::pow(expAttackRatio, srInv / ampAttack)};
+    }
+    else if (state == ATTACK)
+    {
+        res = {0.0, srInv / ampAttack};
+    }
+    else if (state == RELEASING && ampCurve == AEG_EXPONENTIAL)
+    {
+        auto floor = -releaseFrom * expReleaseRatio / (1.0 - expReleaseRatio);
+        res = {floor, releaseFrom - floor, std::pow(expReleaseRatio, srInv / ampRelease)};
     }
     else if (state == RELEASING)
     {
-        auto tn = time / ampRelease;
-        auto tf = (1.0 - tn);
-        AR = releaseFrom * tf;
-        time += srInv;
-        if (time >= ampRelease)
+        res = {releaseFrom, -releaseFrom * srInv / ampRelease};
+    }
+    return res;
+}
+
+/*
+ * renderEnvelope fills gain with the AEG level times the VCA for up to n samples and
+ * returns how many of those the voice sounds for, which is short of n only if it reached
+ * NEWLY_OFF. Each segment is a closed form ramp in envPos, so we find how many samples it
+ * has left, fill the piece of it in this span with fillRamp, and only look at the state
+ * again where a segment ends.
+ */
+int SawDemoVoice::renderEnvelope(float *gain, int n)
+{
+    const double vca = preFilterVCA + preFilterVCAMod + volumeNoteExpressionValue +
+                       (monoMod ? monoMod->preFilterVCAMod : 0.f);
+
+    int s = 0;
+    while (s < n)
+    {
+        // This piece of the segment lasts len samples, and the segment itself 'left' more
+        EnvRamp ramp;
+        auto len = n - s, left = len + 1;
+
+        if (state == ATTACK)
         {
-            state = NEWLY_OFF;
+            left = samplesIn(ampAttack) - envPos;
+            if (!ampGate)
+                ramp = envelopeRamp();
         }
-
-        if (ampGate)
+        else if (state == RELEASING)
         {
-            AR = 1.0;
-            const auto lastSeg = 0.02;
-            if (tn > (1.0 - lastSeg))
+            left = samplesIn(ampRelease) - envPos;
+            if (!ampGate)
             {
-                // Avoid a click with a last 2% fade
-                AR = 1 - (tn - (1.0 - lastSeg)) / lastSeg;
+                ramp = envelopeRamp();
             }
+            else
+            {
+                // Gated, we hold full level until a last 2% fade to avoid a click
+                const auto lastSeg = 0.02;
+                auto fadeFrom = (int)std::floor((1.0 - lastSeg) * ampRelease / srInv) + 1;
+                if (envPos < fadeFrom)
+                    len = std::min(len, fadeFrom - envPos);
+                else
+                    ramp = {1.0 / lastSeg, -srInv / (ampRelease * lastSeg)};
+            }
+        }
+        else if (state != HOLD)
+        {
+            break;
+        }
+        len = std::clamp(len, 0, std::max(left, 0));
+        bool ends = len >= left;
+
+        fillRamp(gain + s, len, ramp, envPos, vca);
+        s += len;
+        envPos += len;
+
+        if (state == HOLD)
+        {
+            envPos = 0;
+            releaseFrom = 1.0;
+        }
+        else if (ends && state == ATTACK)
+        {
+            state = HOLD;
+            envPos = 0;
+            releaseFrom = 1.0;
+        }
+        else if (ends && state == RELEASING)
+        {
+            state = NEWLY_OFF;
         }
     }
-    else if (state == HOLD)
+    return s;
+}
+
+/*
+ * renderOscillators is the per-sample math of the oscillators, with the state pulled into
+ * locals for the duration of the chunk. That lets the compiler keep it all in registers
+ * rather than round-tripping through the voice members every sample. It writes n frames
+ * of interleaved stereo, scaled by the envelope's gain.
+ *
+ * It is instantiated for each unison count and oscillator and start picks the one to
+ * use, so the unison loops have compile time trip counts and unroll completely.
+ */
+template <int N, SawDemoVoice::OscKernel K>
+void SawDemoVoice::renderOscillators(float *LR, const float *gain, int n)
+{
+    static constexpr bool Stateful = (K == DPW_STATEFUL);
+    static constexpr bool Wavetable = (K == WT_LINEAR || K == WT_CUBIC);
+
+    // With no unison there is one centered oscillator, so skip the lanes entirely
+    if constexpr (N == 1 && !Wavetable)
     {
-        AR = 1.0;
-        time = 0;
-        releaseFrom = 1.0;
+        renderOneOscillator<Stateful>(LR, gain, n);
+        return;
+    }
+
+    /*
+     * The unison oscillators run as a structure-of-arrays SIMD kernel. We only walk as
+     * many registers as we need to cover N oscillators; the rest of the last register
+     * is padding with zero gain and zero increment.
+     */
+    using namespace simd;
+    static_assert(N >= 1 && N <= max_uni);
+    static constexpr int nv = (N + double_lanes - 1) / double_lanes;
+
+    const auto one = set1d(1.0), two = set1d(2.0);
+    auto cubic = [one](vdouble x) { return muld(subd(muld(x, x), one), x); };
+
+    vdouble ph[nv], dp[nv], sc[nv], gL[nv], gR[nv], c1[nv], c2[nv];
+    for (int k = 0; k < nv; ++k)
+    {
+        auto o = k * double_lanes;
+        ph[k] = loadd(&phase[o]);
+        dp[k] = loadd(&dPhase[o]);
+        // the 0.25 here is because of the phase rescaling, and the 1/6 is the cubic's
+        // constant which we pull out of the per-sample evaluation
+        auto dpi = loadd(&dPhaseInv[o]);
+        sc[k] = muld(set1d(0.25 / 6.0), muld(dpi, dpi));
+        gL[k] = loadd(&gainL[o]);
+        gR[k] = loadd(&gainR[o]);
+        if constexpr (Stateful)
+        {
+            c1[k] = loadd(&dpwPrev1[o]);
+            c2[k] = loadd(&dpwPrev2[o]);
+        }
+    }
 
-        if (ampGate)
-            AR = 1.0;
+    /*
+     * The stateful differentiator needs the cubic at the previous two sample points. Those
+     * are the last two values we evaluated, unless the phase wrapped (they are then a cycle
+     * out) or the pitch changed (they were spaced by the old increment). In those cases we
+     * evaluate them again from the current phase, which is exactly what the direct path
+     * does every sample.
+     */
+    auto reseed = [&](int k) {
+        auto x0 = subd(muld(ph[k], two), one);
+        auto dx = muld(dp[k], two);
+        c1[k] = cubic(subd(x0, dx));
+        c2[k] = cubic(subd(subd(x0, dx), dx));
+    };
+    if constexpr (Stateful)
+    {
+        if (!dpwSeeded)
+            for (int k = 0; k < nv; ++k)
+                reseed(k);
     }
 
-    AR *= (preFilterVCA + preFilterVCAMod + volumeNoteExpressionValue);
-    L = 0;
-    R = 0;
+    /*
+     * The table reads don't vectorize, so the wavetable oscillators stay scalar. They run
+     * their phase in 32 bit fixed point, which wraps by itself and splits into table index
+     * and fraction with a shift and a mask.
+     */
+    uint32_t wph[N], wdp[N];
+    const float *wt[N];
+    double wgL[N], wgR[N];
+    if constexpr (Wavetable)
+    {
+        for (int u = 0; u < N; ++u)
+        {
+            wph[u] = SawWavetable::toFixed(phase[u]);
+            wdp[u] = SawWavetable::toFixed(dPhase[u]);
+            wt[u] = wavetable->table(wtTable[u]);
+            wgL[u] = gainL[u];
+            wgR[u] = gainR[u];
+        }
+    }
 
-    for (int i = 0; i < unison; ++i)
+    for (int s = 0; s < n; ++s)
     {
+        const float AR = gain[s];
+
         /*
          * Use a cubic integrated saw and second derive it at
          * each point. This is basically the math I worked
@@ -113,30 +437,160 @@ void SawDemoVoice::step()
          * which gives a clean saw is phase^3 / 6 - phase / 6.
          * Evaluate it at 3 points and then differentiate it like
          * we do in Surge Modern. The waveform is the same both
-         * channels.
+         * channels; the pan and unison normalization are folded into
+         * gainL and gainR and the envelope is applied once to the sum.
+         *
+         * Pulling the 1/6 out and summing in a different order means this
+         * doesn't bit-match the one-oscillator-at-a-time loop it replaced; it
+         * agrees to within about 1e-6 of full scale (test_voice checks 1e-5).
          */
-        double phaseSteps[3];
-        for (int q = -2; q <= 0; ++q)
+        if constexpr (Wavetable)
+        {
+            double aL = 0, aR = 0;
+            for (int u = 0; u < N; ++u)
+            {
+                double saw;
+                if constexpr (K == WT_CUBIC)
+                    saw = SawWavetable::readCubic(wt[u], wph[u]);
+                else
+                    saw = SawWavetable::readLinear(wt[u], wph[u]);
+                aL += wgL[u] * saw;
+                aR += wgR[u] * saw;
+                wph[u] += wdp[u];
+            }
+
+            LR[2 * s] = AR * aL;
+            LR[2 * s + 1] = AR * aR;
+        }
+        else
+        {
+            vdouble aL = set1d(0.0), aR = set1d(0.0);
+            for (int k = 0; k < nv; ++k)
+            {
+                // Our calculation assumes phase in -1,1 and this phase is in 0 1 so
+                auto x0 = subd(muld(ph[k], two), one);
+                auto c0 = cubic(x0);
+
+                vdouble saw;
+                if constexpr (Stateful)
+                {
+                    saw = muld(subd(addd(c0, c2[k]), muld(two, c1[k])), sc[k]);
+                    c2[k] = c1[k];
+                    c1[k] = c0;
+                }
+                else
+                {
+                    auto dx = muld(dp[k], two);
+                    auto x1 = subd(x0, dx);
+                    auto x2 = subd(x1, dx);
+                    saw = muld(subd(addd(c0, cubic(x2)), muld(two, cubic(x1))), sc[k]);
+                }
+                aL = addd(aL, muld(gL[k], saw));
+                aR = addd(aR, muld(gR[k], saw));
+
+                if constexpr (Stateful)
+                {
+                    bool wrapped;
+                    ph[k] = wrapd(addd(ph[k], dp[k]), wrapped);
+                    if (wrapped)
+                        reseed(k);
+                }
+                else
+                {
+                    ph[k] = wrapd(addd(ph[k], dp[k]));
+                }
+            }
+
+            LR[2 * s] = AR * hsumd(aL);
+            LR[2 * s + 1] = AR * hsumd(aR);
+        }
+    }
+
+    if constexpr (Wavetable)
+    {
+        for (int u = 0; u < N; ++u)
+            phase[u] = SawWavetable::fromFixed(wph[u]);
+    }
+    else
+    {
+        for (int k = 0; k < nv; ++k)
+        {
+            stored(&phase[k * double_lanes], ph[k]);
+            if constexpr (Stateful)
+            {
+                stored(&dpwPrev1[k * double_lanes], c1[k]);
+                stored(&dpwPrev2[k * double_lanes], c2[k]);
+            }
+        }
+    }
+    if constexpr (Stateful)
+        dpwSeeded = true;
+}
+
+/*
+ * renderOneOscillator is renderOscillators for a single DPW oscillator, in plain doubles.
+ * It is the same math as lane 0 of the SIMD kernel, without the padding lanes and the
+ * horizontal sums.
+ */
+template <bool Stateful> void SawDemoVoice::renderOneOscillator(float *LR, const float *gain, int n)
+{
+    auto cubic = [](double x) { return (x * x - 1) * x; };
+
+    double ph = phase[0], dp = dPhase[0], g = gainL[0];
+    double sc = 0.25 / 6.0 * (dPhaseInv[0] * dPhaseInv[0]);
+
+    double c1{0}, c2{0};
+    auto reseed = [&]() {
+        auto x0 = ph * 2 - 1, dx = dp * 2;
+        c1 = cubic(x0 - dx);
+        c2 = cubic(x0 - dx - dx);
+    };
+    if constexpr (Stateful)
+    {
+        c1 = dpwPrev1[0];
+        c2 = dpwPrev2[0];
+        if (!dpwSeeded)
+            reseed();
+    }
+
+    for (int s = 0; s < n; ++s)
+    {
+        double x0 = ph * 2 - 1;
+        double c0 = cubic(x0);
+
+        double saw;
+        if constexpr (Stateful)
         {
-            double ph = phase[i] + q * dPhase[i];
-            // Our calculation assumes phase in -1,1 and this phase is
-            // in 0 1 so
-            ph = ph * 2 - 1;
-            phaseSteps[q + 2] = (ph * ph - 1) * ph / 6.0;
+            saw = (c0 + c2 - 2 * c1) * sc;
+            c2 = c1;
+            c1 = c0;
+        }
+        else
+        {
+            double dx = dp * 2;
+            double x1 = x0 - dx;
+            saw = (c0 + cubic(x1 - dx) - 2 * cubic(x1)) * sc;
         }
-        // the 0.25 here is because of the phase rescaling again
-        double saw = (phaseSteps[0] + phaseSteps[2] - 2 * phaseSteps[1]) * 0.25 * dPhaseInv[i] *
-                     dPhaseInv[i];
 
-        L += 0.2 * norm[i] * AR * panL[i] * saw;
-        R += 0.2 * norm[i] * AR * panR[i] * saw;
+        ph += dp;
+        if (ph > 1)
+        {
+            ph -= 1;
+            if constexpr (Stateful)
+                reseed();
+        }
 
-        phase[i] += dPhase[i];
-        if (phase[i] > 1)
-            phase[i] -= 1;
+        // a single oscillator is centered, so both channels get the same signal
+        LR[2 * s] = LR[2 * s + 1] = gain[s] * (g * saw);
     }
 
-    filter.step(L, R);
+    phase[0] = ph;
+    if constexpr (Stateful)
+    {
+        dpwPrev1[0] = c1;
+        dpwPrev2[0] = c2;
+        dpwSeeded = true;
+    }
 }
 
 void SawDemoVoice::start(int key)
@@ -146,15 +600,31 @@ void SawDemoVoice::start(int key)
     filter.init();
     this->key = key;
     state = (ampAttack > 0 ? ATTACK : HOLD);
-    time = 0;
+    envPos = 0;
+    quietFor = 0;
+
+    // Before anything indexes the per-lane arrays by it
+    unison = std::clamp(unison, 1, max_uni);
+
+    // Clear every lane so the padding past our unison count is silent
+    for (int i = 0; i < uni_lanes; ++i)
+    {
+        phase[i] = 0.0;
+        dPhase[i] = 0.0;
+        dPhaseInv[i] = 0.0;
+        gainL[i] = 0.0;
+        gainR[i] = 0.0;
+        dpwPrev1[i] = 0.0;
+        dpwPrev2[i] = 0.0;
+    }
 
+    // 0.2 is just an overall output level so a few voices don't clip
     if (unison == 1)
     {
         unitShift[0] = 0;
-        panL[0] = 1;
-        panR[0] = 1;
         phase[0] = 0.0;
-        norm[0] = 1.0;
+        gainL[0] = 0.2;
+        gainR[0] = 0.2;
     }
     else
     {
@@ -163,32 +633,120 @@ void SawDemoVoice::start(int key)
             float dI = 1.0 * i / (unison - 1);
             unitShift[i] = 2 * dI - 1;
             phase[i] = dI;
-            panL[i] = std::cos(0.5 * pival * dI);
-            panR[i] = std::sin(0.5 * pival * dI);
 
-            norm[i] = 1.0 / sqrt(unison);
+            float panL = std::cos(0.5 * pival * dI);
+            float panR = std::sin(0.5 * pival * dI);
+            float norm = 1.0 / sqrt(unison);
+            gainL[i] = 0.2 * norm * panL;
+            gainR[i] = 0.2 * norm * panR;
         }
     }
 
+    static constexpr renderOscFn_t kernels[num_kernels][max_uni] = {
+        {&SawDemoVoice::renderOscillators<1, DPW_DIRECT>,
+         &SawDemoVoice::renderOscillators<2, DPW_DIRECT>,
+         &SawDemoVoice::renderOscillators<3, DPW_DIRECT>,
+         &SawDemoVoice::renderOscillators<4, DPW_DIRECT>,
+         &SawDemoVoice::renderOscillators<5, DPW_DIRECT>,
+         &SawDemoVoice::renderOscillators<6, DPW_DIRECT>,
+         &SawDemoVoice::renderOscillators<7, DPW_DIRECT>},
+        {&SawDemoVoice::renderOscillators<1, DPW_STATEFUL>,
+         &SawDemoVoice::renderOscillators<2, DPW_STATEFUL>,
+         &SawDemoVoice::renderOscillators<3, DPW_STATEFUL>,
+         &SawDemoVoice::renderOscillators<4, DPW_STATEFUL>,
+         &SawDemoVoice::renderOscillators<5, DPW_STATEFUL>,
+         &SawDemoVoice::renderOscillators<6, DPW_STATEFUL>,
+         &SawDemoVoice::renderOscillators<7, DPW_STATEFUL>},
+        {&SawDemoVoice::renderOscillators<1, WT_LINEAR>,
+         &SawDemoVoice::renderOscillators<2, WT_LINEAR>,
+         &SawDemoVoice::renderOscillators<3, WT_LINEAR>,
+         &SawDemoVoice::renderOscillators<4, WT_LINEAR>,
+         &SawDemoVoice::renderOscillators<5, WT_LINEAR>,
+         &SawDemoVoice::renderOscillators<6, WT_LINEAR>,
+         &SawDemoVoice::renderOscillators<7, WT_LINEAR>},
+        {&SawDemoVoice::renderOscillators<1, WT_CUBIC>,
+         &SawDemoVoice::renderOscillators<2, WT_CUBIC>,
+         &SawDemoVoice::renderOscillators<3, WT_CUBIC>,
+         &SawDemoVoice::renderOscillators<4, WT_CUBIC>,
+         &SawDemoVoice::renderOscillators<5, WT_CUBIC>,
+         &SawDemoVoice::renderOscillators<6, WT_CUBIC>,
+         &SawDemoVoice::renderOscillators<7, WT_CUBIC>}};
+
+    // The wavetable engines need the table set, so without it we fall back to DPW
+    auto kernel = statefulDPW ? DPW_STATEFUL : DPW_DIRECT;
+    if (wavetable && oscEngine == OSC_WAVETABLE_LINEAR)
+        kernel = WT_LINEAR;
+    else if (wavetable && oscEngine == OSC_WAVETABLE_CUBIC)
+        kernel = WT_CUBIC;
+
+    renderOscFn = kernels[kernel][unison - 1];
+    usesWavetable = (kernel == WT_LINEAR || kernel == WT_CUBIC);
+
     recalcPitch();
-    recalcFilter();
+    jumpFilter();
 }
 
 void SawDemoVoice::release()
 {
+    // Release from wherever the attack got to, which is the last level it rendered
+    if (state == ATTACK && envPos > 0)
+        releaseFrom = envelopeRamp().at(envPos - 1);
+
     state = RELEASING;
-    time = 0;
+    envPos = 0;
 
-    if (time >= ampRelease)
+    if (ampRelease <= 0)
         state = NEWLY_OFF;
 }
 
+void SawDemoVoice::StereoSimperSVF::copyCoeff(const StereoSimperSVF &other)
+{
+    g = other.g;
+    k = other.k;
+    gk = other.gk;
+    a1 = other.a1;
+    a2 = other.a2;
+    a3 = other.a3;
+    ak = other.ak;
+}
+
+void SawDemoVoice::StereoSimperSVF::glideTo(const StereoSimperSVF &other, int samples)
+{
+    target = {other.k, other.a1, other.a2, other.a3, other.ak};
+    auto inv = 1.f / samples;
+    delta = {(target.k - k) * inv, (target.a1 - a1) * inv, (target.a2 - a2) * inv,
+            (target.a3 - a3) * inv, (target.ak - ak) * inv};
+    glideLeft = samples;
+
+    // g and gk only feed the others, so they can go straight to their end values
+    g = other.g;
+    gk = other.gk;
+}
+
+void SawDemoVoice::StereoSimperSVF::advanceGlide()
+{
+    if (--glideLeft > 0)
+    {
+        k += delta.k;
+        a1 += delta.a1;
+        a2 += delta.a2;
+        a3 += delta.a3;
+        ak += delta.ak;
+        return;
+    }
+    k = target.k;
+    a1 = target.a1;
+    a2 = target.a2;
+    a3 = target.a3;
+    ak = target.ak;
+}
+
 void SawDemoVoice::StereoSimperSVF::setCoeff(float key, float res, float srInv)
 {
-    auto co = 440.0 * pow(2.0, (key - 69.0) / 12);
+    auto co = 440.0 * dspmath::semitonesToRatio(key - 69.0);
     co = std::clamp(co, 10.0, 15000.0); // just to be safe/lazy
     res = std::clamp(res, 0.01f, 0.99f);
-    g = std::tan(pival * co * srInv);
+    g = dspmath::prewarpTan(pival * co * srInv);
     k = 2.0 - 2.0 * res;
     gk = g + k;
     a1 = 1.0 / (1.0 + g * gk);
@@ -197,47 +755,136 @@ void SawDemoVoice::StereoSimperSVF::setCoeff(float key, float res, float srInv)
     ak = gk * a1;
 }
 
-void SawDemoVoice::StereoSimperSVF::step(float &L, float &R)
+/*
+ * The filter kernel is specialized per mode at compile time, so the only thing which
+ * varies per sample is the data. Both channels run together in the low two lanes of
+ * a vector, which is why the kernels take interleaved stereo. setMode picks the kernel.
+ * Any samples of a coefficient glide run first through the Glide version of the span,
+ * which steps the coefficients each sample, and the rest with them held. The glide's last
+ * sample lands on its target, so that one runs with the held coefficients too.
+ */
+template <SawDemoVoice::StereoSimperSVF::Mode M>
+void SawDemoVoice::StereoSimperSVF::processBlock(StereoSimperSVF &f, float *LR, int n)
 {
-    float vin[2]{L, R};
-    float res[2]{0, 0};
-    for (int c = 0; c < 2; ++c)
-    {
-        auto v3 = vin[c] - ic2eq[c];
-        auto v0 = a1 * v3 - ak * ic1eq[c];
-        auto v1 = a2 * v3 + a1 * ic1eq[c];
-        auto v2 = a3 * v3 + a2 * ic1eq[c] + ic2eq[c];
+    auto gn = std::min(n, f.glideLeft);
+    if (gn == f.glideLeft && gn > 0)
+        gn--;
+    if (gn > 0)
+        processSpan<M, true>(f, LR, gn);
+    if (gn < n && f.glideLeft == 1)
+        f.advanceGlide();
+    processSpan<M, false>(f, LR + 2 * gn, n - gn);
+}
 
-        ic1eq[c] = 2 * v1 - ic1eq[c];
-        ic2eq[c] = 2 * v2 - ic2eq[c];
+template <SawDemoVoice::StereoSimperSVF::Mode M, bool Glide>
+void SawDemoVoice::StereoSimperSVF::processSpan(StereoSimperSVF &f, float *LR, int n)
+{
+    using namespace simd;
+    auto ic1 = loadst(f.ic1eq), ic2 = loadst(f.ic2eq);
+    auto ca1 = set1st(f.a1), ca2 = set1st(f.a2), ca3 = set1st(f.a3), cak = set1st(f.ak);
+    auto ck = set1st(f.k);
+    const auto two = set1st(2.f);
 
-        // I know that a branch in this loop is inefficient and so on
-        // remember this is mostly showing you how it hangs together.
-        switch (mode)
+    // The same adds as advanceGlide, which the voice bank uses, just kept in registers
+    vstereo d1, d2, d3, dk, dkk;
+    if constexpr (Glide)
+    {
+        d1 = set1st(f.delta.a1);
+        d2 = set1st(f.delta.a2);
+        d3 = set1st(f.delta.a3);
+        dk = set1st(f.delta.ak);
+        dkk = set1st(f.delta.k);
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        if constexpr (Glide)
         {
-        case LP:
-            res[c] = v2;
-            break;
-        case BP:
-            res[c] = v1;
-            break;
-        case HP:
-            res[c] = v0;
-            break;
-        case NOTCH:
-            res[c] = v2 + v0; // low + high
-            break;
-        case PEAK:
-            res[c] = v2 - v0; // low - high;
-            break;
-        case ALL:
-            res[c] = v2 + v0 - k * v1; // low + high - k * band
-            break;
+            ca1 = addst(ca1, d1);
+            ca2 = addst(ca2, d2);
+            ca3 = addst(ca3, d3);
+            cak = addst(cak, dk);
+            ck = addst(ck, dkk);
         }
+
+        auto vin = loadst(LR + 2 * i);
+        auto v3 = subst(vin, ic2);
+        auto v0 = subst(mulst(ca1, v3), mulst(cak, ic1));
+        auto v1 = addst(mulst(ca2, v3), mulst(ca1, ic1));
+        auto v2 = addst(addst(mulst(ca3, v3), mulst(ca2, ic1)), ic2);
+
+        ic1 = subst(mulst(two, v1), ic1);
+        ic2 = subst(mulst(two, v2), ic2);
+
+        vstereo res;
+        if constexpr (M == LP)
+            res = v2;
+        else if constexpr (M == BP)
+            res = v1;
+        else if constexpr (M == HP)
+            res = v0;
+        else if constexpr (M == NOTCH)
+            res = addst(v2, v0); // low + high
+        else if constexpr (M == PEAK)
+            res = subst(v2, v0); // low - high
+        else
+            res = subst(addst(v2, v0), mulst(ck, v1)); // low + high - k * band
+
+        storest(LR + 2 * i, res);
     }
 
-    L = res[0];
-    R = res[1];
+    storest(f.ic1eq, ic1);
+    storest(f.ic2eq, ic2);
+
+    if constexpr (Glide)
+    {
+        float c[2];
+        storest(c, ca1);
+        f.a1 = c[0];
+        storest(c, ca2);
+        f.a2 = c[0];
+        storest(c, ca3);
+        f.a3 = c[0];
+        storest(c, cak);
+        f.ak = c[0];
+        storest(c, ck);
+        f.k = c[0];
+        f.glideLeft -= n;
+    }
+}
+
+void SawDemoVoice::StereoSimperSVF::setMode(Mode m)
+{
+    mode = m;
+    switch (m)
+    {
+    case LP:
+        processFn = &processBlock<LP>;
+        break;
+    case HP:
+        processFn = &processBlock<HP>;
+        break;
+    case BP:
+        processFn = &processBlock<BP>;
+        break;
+    case NOTCH:
+        processFn = &processBlock<NOTCH>;
+        break;
+    case PEAK:
+        processFn = &processBlock<PEAK>;
+        break;
+    case ALL:
+        processFn = &processBlock<ALL>;
+        break;
+    }
+}
+
+void SawDemoVoice::StereoSimperSVF::step(float &L, float &R)
+{
+    float LR[2]{L, R};
+    processFn(*this, LR, 1);
+    L = LR[0];
+    R = LR[1];
 }
 
 void SawDemoVoice::StereoSimperSVF::init()
@@ -248,4 +895,15 @@ void SawDemoVoice::StereoSimperSVF::init()
         ic2eq[c] = 0.f;
     }
 }
+
+void SawDemoVoice::StereoSimperSVF::flushDenormals()
+{
+    for (int c = 0; c < 2; ++c)
+    {
+        if (std::fabs(ic1eq[c]) < denormal_floor)
+            ic1eq[c] = 0.f;
+        if (std::fabs(ic2eq[c]) < denormal_floor)
+            ic2eq[c] = 0.f;
+    }
+}
 } // namespace sst::clap_saw_demo
\ No newline at end of file
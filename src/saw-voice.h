@@ -11,14 +11,17 @@
 #define CLAP_SAW_DEMO_VOICE_H
 
 #include <array>
+#include <cmath>
 #include "debug-helpers.h"
+#include "saw-wavetable.h"
 
 namespace sst::clap_saw_demo
 {
 /*
  * SawDemoVoice is a single voice with the following features
  *
- * - A saw wave generated using a second derivative of a cubic curve
+ * - A saw wave generated using a second derivative of a cubic curve, or read
+ *   from a set of band-limited wavetables
  * - Internal unison from 1-7 with detuning from 0 - 100 cents
  * - A simple AR envelope; and an independent VCA level
  * - A multi-mode SVF filter
@@ -35,10 +38,16 @@ namespace sst::clap_saw_demo
  * The API is pretty direct, exposing members which you can just write
  * to from the Audio thread.
  */
-struct SawDemoVoice
+// Voices start on a cache line of their own, so neighbours in a pool never share one
+struct alignas(64) SawDemoVoice
 {
     static constexpr int max_uni = 7;
 
+    // The unison oscillators are stored structure-of-arrays and padded out to uni_lanes
+    // so the kernel can run them a full SIMD register at a time (see simd-helpers.h).
+    // Padding lanes carry zero gain and so contribute nothing.
+    static constexpr int uni_lanes = 8;
+
     int portid;  // clap note port index
     int channel; // midi channel
     int key;     // The midi key which triggered me
@@ -47,7 +56,27 @@ struct SawDemoVoice
     // unison count is snapped at voice on
     int unison{3};
 
-    // Note the pattern that we have an item and its modulator as the API
+    // The saw is the second difference of a cubic. The stateful differentiator remembers
+    // the cubic at the previous two samples and so evaluates one cubic a sample rather
+    // than three. The direct one evaluates all three. Also snapped at voice on.
+    bool statefulDPW{true};
+
+    // Which oscillator makes the saw, also snapped at voice on. The wavetable engines
+    // read the shared band-limited tables in 'wavetable', so set that first.
+    enum OscEngine
+    {
+        OSC_DPW,
+        OSC_WAVETABLE_LINEAR,
+        OSC_WAVETABLE_CUBIC
+    };
+    int oscEngine{OSC_DPW};
+    const SawWavetable *wavetable{nullptr};
+
+    // Whether start picked a wavetable kernel. The voice-parallel bank only runs DPW.
+    bool usesWavetable{false};
+
+    // Note the pattern that we have an item and its modulator as the API. The modulators
+    // here are this voice's own polyphonic ones; monophonic modulation lives in monoMod.
     float uniSpread{10.0}, uniSpreadMod{0.0};
 
     // The oscillator detuning
@@ -58,12 +87,26 @@ struct SawDemoVoice
     float cutoff{69.0}, res{0.7};
     float cutoffMod{0.0}, resMod{0.0};
 
+    // With filterGlide at 0 recalcFilter changes the coefficients at once. Otherwise a
+    // playing voice works out new coefficients at most every filterGlide samples, at a
+    // control rate tick, and glides to them linearly over the next filterGlide samples.
+    // A change of mode always jumps.
+    int filterGlide{0};
+
     // The internal AEG is incredibly simple. Bypass or not, and have
     // an attack and release time in seconds. These aren't modulatable
     // mostly out of laziness.
     bool ampGate{false};
     float ampAttack{0.01}, ampRelease{0.1};
 
+    // The attack and release are straight lines, or exponential curves which start and
+    // finish at the same levels and times
+    enum AEGCurve
+    {
+        AEG_LINEAR,
+        AEG_EXPONENTIAL
+    } ampCurve{AEG_LINEAR};
+
     // The pre-filter VCA is unique in that it can be either internally
     // modulated and externally modulated. If ampGate is false, the internal
     // modulation is bypassed. The two vectors for modulation are a VCAMod
@@ -90,7 +133,7 @@ struct SawDemoVoice
         RELEASING
     } state{OFF};
 
-    // L / R are the output.
+    // L / R are the output of 'step'.
     float L{0.f}, R{0.f};
 
     // start, then step the voice forever. release it on note off. sometime after that
@@ -100,6 +143,45 @@ struct SawDemoVoice
     void step();
     void release();
 
+    // renderBlock is the block version of step. It *accumulates* up to nframes samples
+    // into L and R (so zero them first if you want only this voice) and stops early,
+    // leaving the remainder untouched, if the voice reaches NEWLY_OFF in the block.
+    void renderBlock(float *L, float *R, int nframes);
+
+    // renderBlock works through its span in chunks of at most this many frames
+    static constexpr int block_chunk = 64;
+
+    /*
+     * The voice's control rate. At each tick it starts any pending filter glide, and its
+     * chunks never cross a tick, so the envelope ramps are worked out at least that often.
+     * Ticks come every controlRate() samples: the filter glide length if there is one,
+     * so each glide runs tick to tick, otherwise control_rate times controlRateScale,
+     * which an engine running us oversampled sets to its factor so a tick lasts as long.
+     * tickLeft counts down to the next; an engine sets it at voice on to line its voices'
+     * ticks up.
+     */
+    static constexpr int control_rate = 16;
+    int controlRateScale{1};
+    int tickLeft{0};
+    int controlRate() const
+    {
+        return filterGlide > 0 ? filterGlide : control_rate * controlRateScale;
+    }
+
+    /*
+     * A releasing voice whose envelope gain (VCA included) and filter output have both
+     * stayed under silence_threshold for silence_hold samples is finished, however much
+     * of its release is left, so a voice with its VCA at zero doesn't run the oscillators
+     * and filter for nothing. Watching the gain as well as the output means a low note
+     * through a high pass, which is quiet between its edges, isn't taken for silence, and
+     * the hold lets a ringing filter die away. trackSilence takes the larger of the two
+     * peaks for each chunk the voice renders, and can move it to NEWLY_OFF.
+     */
+    static constexpr float silence_threshold = 1e-5f; // -100dB
+    static constexpr int silence_hold = 256;
+    int quietFor{0};
+    void trackSilence(float peak, int n);
+
     void recalcPitch();
     void recalcFilter();
 
@@ -109,6 +191,16 @@ struct SawDemoVoice
     {
         float ic1eq[2]{0.f, 0.f}, ic2eq[2]{0.f, 0.f};
         float g{0.f}, k{0.f}, gk{0.f}, a1{0.f}, a2{0.f}, a3{0.f}, ak{0.f};
+
+        // A glide to new coefficients. Each sample of it adds 'delta' to the coefficients
+        // before filtering, and the last one lands exactly on 'target'.
+        struct Coeffs
+        {
+            float k{0.f}, a1{0.f}, a2{0.f}, a3{0.f}, ak{0.f};
+        };
+        Coeffs target, delta;
+        int glideLeft{0};
+
         enum Mode
         {
             LP,
@@ -119,20 +211,118 @@ struct SawDemoVoice
             ALL
         } mode{LP};
 
-        float low[2], band[2], high[2], notch[2], peak[2], all[2];
+        // processFn filters n frames of interleaved stereo in place. It points at the
+        // processBlock specialization for our mode; change mode with setMode to keep
+        // the two in sync.
+        typedef void (*processFn_t)(StereoSimperSVF &, float *LR, int n);
+        processFn_t processFn{&processBlock<LP>};
+
+        template <Mode M> static void processBlock(StereoSimperSVF &, float *LR, int n);
+        template <Mode M, bool Glide>
+        static void processSpan(StereoSimperSVF &, float *LR, int n);
+
+        void setMode(Mode m);
         void setCoeff(float key, float res, float srInv);
+        void copyCoeff(const StereoSimperSVF &other);
+        void glideTo(const StereoSimperSVF &other, int samples);
+        void advanceGlide();
         void step(float &L, float &R);
         void init();
+
+        // Zeroes integrator state too small to hear. A decaying filter would otherwise sit
+        // in denormals for a long time wherever ScopedFlushDenormals isn't in force.
+        static constexpr float denormal_floor = 1e-15f;
+        void flushDenormals();
     } filter;
 
+    /*
+     * Monophonic modulation is the same for every voice, so the engine keeps one of these
+     * and points each voice at it. Its filter has the coefficients for the filter params
+     * plus the mono modulation; recalcFilter copies those, rather than computing the same
+     * ones again, for a voice with no polyphonic filter modulation of its own.
+     */
+    struct MonoModulation
+    {
+        float cutoffMod{0}, resMod{0}, uniSpreadMod{0}, oscDetuneMod{0}, preFilterVCAMod{0};
+
+        // The values the filter is for. Call recalcFilter after changing these or the mods.
+        int filterMode{StereoSimperSVF::Mode::LP};
+        float cutoff{69.0}, res{0.7};
+        float sampleRate{0};
+        double srInv{0};
+        StereoSimperSVF filter;
+
+        // The mods the filter was last computed with. The engine defers recalcFilter to
+        // the end of a sample's events, so a voice starting before then sees these differ
+        // from cutoffMod and resMod, and computes its own coefficients instead.
+        float filterCutoffMod{0}, filterResMod{0};
+
+        void recalcFilter();
+        bool sharesFilterWith(const SawDemoVoice &v) const;
+    };
+    const MonoModulation *monoMod{nullptr};
+
   private:
+    // The voice-parallel engine reads and writes our state directly. See saw-voice-bank.h
+    friend struct SawDemoVoiceBank;
+
+    // The control rate tick: starts a glide to the current filter params if recalcFilter
+    // asked for one and the last glide is done
+    void updateFilterGlide();
+    void jumpFilter();
+    void filterCoeffFor(StereoSimperSVF &f) const;
+    bool filterPending{false};
+
+    // The envelope and oscillator kernel, one per unison count and oscillator, chosen
+    // in start
+    enum OscKernel
+    {
+        DPW_DIRECT,
+        DPW_STATEFUL,
+        WT_LINEAR,
+        WT_CUBIC,
+        num_kernels
+    };
+    template <int N, OscKernel K> void renderOscillators(float *LR, const float *gain, int n);
+    template <bool Stateful> void renderOneOscillator(float *LR, const float *gain, int n);
+    typedef void (SawDemoVoice::*renderOscFn_t)(float *LR, const float *gain, int n);
+    renderOscFn_t renderOscFn{&SawDemoVoice::renderOscillators<1, DPW_STATEFUL>};
+
+    /*
+     * The AEG level through the current attack or release: a + b * envPos for a linear
+     * one, and a + b * r^envPos for an exponential one (where r is not 0)
+     */
+    struct EnvRamp
+    {
+        double a{1.0}, b{0.0}, r{0.0};
+        double at(int pos) const { return r > 0 ? a + b * std::pow(r, pos) : a + b * pos; }
+    };
+    EnvRamp envelopeRamp() const;
+    static void fillRamp(float *gain, int n, const EnvRamp &ramp, int pos, double vca);
+    int renderEnvelope(float *gain, int n);
+    int samplesIn(float seconds) const;
+    void controlTick();
+
     double baseFreq{440.0};
     double srInv{1.0 / 44100.0};
-    float time{0}, filterTime{0};
+    float filterTime{0};
     float releaseFrom{1.0};
 
-    std::array<float, max_uni> panL, panR, unitShift, norm;
-    std::array<double, max_uni> phase, dPhase, dPhaseInv;
+    // How many samples into its current segment the envelope is
+    int envPos{0};
+
+    std::array<float, max_uni> unitShift;
+
+    // gainL and gainR fold the output scaling, unison normalization and pan together
+    alignas(32) std::array<double, uni_lanes> phase, dPhase, dPhaseInv, gainL, gainR;
+
+    // The stateful differentiator's cubic at the previous two samples, and whether
+    // those are still valid for the current phase and increment
+    alignas(32) std::array<double, uni_lanes> dpwPrev1, dpwPrev2;
+    bool dpwSeeded{false};
+
+    // The wavetable each unison oscillator reads, chosen from its increment in recalcPitch
+    std::array<int, max_uni> wtTable{};
 };
 } // namespace sst::clap_saw_demo
 #endif
@@ -0,0 +1,68 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#include "saw-wavetable.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace sst::clap_saw_demo
+{
+const SawWavetable &SawWavetable::instance()
+{
+    static SawWavetable table;
+    return table;
+}
+
+int SawWavetable::tableFor(double dPhase)
+{
+    // This is ceil(log2(dPhase * table_size)), read off the exponent rather than computed
+    int e;
+    auto m = std::frexp(dPhase * table_size, &e);
+    auto t = (m == 0.5) ? e - 1 : e;
+    return std::clamp(t, 0, num_tables - 1);
+}
+
+/*
+ * The saw the DPW oscillator makes rises from -1 to 1 over a cycle, which is
+ *
+ *    2 phase - 1 = -2 / pi sum_k sin(2 pi k phase) / k
+ *
+ * We build from the top table down, since each table is the one above it plus
+ * the next octave of harmonics. Every harmonic lands on a point of a single cycle
+ * of sine at the table resolution, so that is the only sine we evaluate.
+ */
+SawWavetable::SawWavetable()
+{
+    const double pi = 3.14159265358979323846;
+    std::vector<double> sine(table_size), acc(table_size, 0.0);
+    for (int i = 0; i < table_size; ++i)
+        sine[i] = std::sin(2.0 * pi * i / table_size);
+
+    int harmonicsSoFar = 0;
+    for (int t = num_tables - 1; t >= 0; --t)
+    {
+        auto harmonics = (table_size / 2) >> t;
+        for (int k = harmonicsSoFar + 1; k <= harmonics; ++k)
+        {
+            auto amp = -2.0 / (pi * k);
+            for (int i = 0; i < table_size; ++i)
+                acc[i] += amp * sine[(k * i) % table_size];
+        }
+        harmonicsSoFar = harmonics;
+
+        auto *d = data[t];
+        for (int i = 0; i < table_size; ++i)
+            d[i + 1] = (float)acc[i];
+        d[0] = d[table_size];
+        d[table_size + 1] = d[1];
+        d[table_size + 2] = d[2];
+    }
+}
+} // namespace sst::clap_saw_demo
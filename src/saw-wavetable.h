@@ -0,0 +1,86 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_SAW_WAVETABLE_H
+#define CLAP_SAW_DEMO_SAW_WAVETABLE_H
+
+#include <cstdint>
+
+namespace sst::clap_saw_demo
+{
+/*
+ * SawWavetable is a mipmapped set of band-limited saw tables, one per octave of phase
+ * increment, which the voice can read instead of running the DPW oscillator. A table
+ * lookup is a lot cheaper than three cubics in double precision, and it has none of the
+ * DPW's precision trouble at low frequencies.
+ *
+ * The tables are a function of the phase increment (that is frequency over sample rate),
+ * not of the sample rate itself, so a single set serves every sample rate, voice and
+ * plugin instance in the process. Get it with instance(), which builds it on first use;
+ * activate calls that so the build never lands on the audio thread.
+ */
+struct SawWavetable
+{
+    static constexpr int table_size = 2048;
+
+    // Table t holds (table_size / 2) >> t harmonics, so it is alias free for phase
+    // increments up to 2^t / table_size. The last table is a sine.
+    static constexpr int num_tables = 11;
+
+    static const SawWavetable &instance();
+
+    // Which table to read for a given phase increment
+    static int tableFor(double dPhase);
+
+    /*
+     * The readers take the phase as 32 bit fixed point, so the top table_bits bits are
+     * the table index and the rest the fraction, which is a lot cheaper to split than a
+     * double. The tables have a guard point before the start and two past the end so
+     * neither interpolation has to wrap its indices.
+     */
+    static constexpr int table_bits = 11;
+    static constexpr int frac_bits = 32 - table_bits;
+    static_assert(table_size == 1 << table_bits);
+
+    // phase is in [0,1]; a phase of exactly 1 wraps to 0 as it should
+    static inline uint32_t toFixed(double phase)
+    {
+        return (uint32_t)(uint64_t)(phase * 4294967296.0);
+    }
+    static inline double fromFixed(uint32_t phase) { return phase * (1.0 / 4294967296.0); }
+
+    inline const float *table(int t) const { return data[t]; }
+
+    static inline float readLinear(const float *table, uint32_t phase)
+    {
+        auto f = (float)(phase & ((1U << frac_bits) - 1)) * (1.f / (1U << frac_bits));
+        const float *p = table + (phase >> frac_bits) + 1;
+        return p[0] + f * (p[1] - p[0]);
+    }
+
+    static inline float readCubic(const float *table, uint32_t phase)
+    {
+        auto f = (float)(phase & ((1U << frac_bits) - 1)) * (1.f / (1U << frac_bits));
+        const float *p = table + (phase >> frac_bits);
+
+        // 4 point, 3rd order Hermite
+        auto c1 = 0.5f * (p[2] - p[0]);
+        auto c2 = p[0] - 2.5f * p[1] + 2.f * p[2] - 0.5f * p[3];
+        auto c3 = 0.5f * (p[3] - p[0]) + 1.5f * (p[1] - p[2]);
+        return ((c3 * f + c2) * f + c1) * f + p[1];
+    }
+
+  private:
+    SawWavetable();
+
+    float data[num_tables][table_size + 3];
+};
+} // namespace sst::clap_saw_demo
+
+#endif
@@ -0,0 +1,222 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_SIMD_HELPERS_H
+#define CLAP_SAW_DEMO_SIMD_HELPERS_H
+
+/*
+ * A very small wrapper over the instruction sets the voice kernels use, so those
+ * kernels can be written once against 'vdouble', 'vfloat' and friends. We pick the widest
+ * set the compiler was told it may use: AVX if you build with -mavx (or /arch:AVX),
+ * SSE2 which every x86-64 machine has, and a single lane scalar fallback everywhere
+ * else. Nothing here dispatches at runtime.
+ */
+#if defined(__AVX__)
+#define CLAP_SAW_DEMO_SIMD_AVX 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CLAP_SAW_DEMO_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace sst::clap_saw_demo::simd
+{
+#if CLAP_SAW_DEMO_SIMD_AVX
+using vdouble = __m256d;
+static constexpr int double_lanes = 4;
+
+inline vdouble loadd(const double *p) { return _mm256_loadu_pd(p); }
+inline void stored(double *p, vdouble v) { _mm256_storeu_pd(p, v); }
+inline vdouble set1d(double d) { return _mm256_set1_pd(d); }
+inline vdouble addd(vdouble a, vdouble b) { return _mm256_add_pd(a, b); }
+inline vdouble subd(vdouble a, vdouble b) { return _mm256_sub_pd(a, b); }
+inline vdouble muld(vdouble a, vdouble b) { return _mm256_mul_pd(a, b); }
+// returns a - 1 in the lanes where a > 1, a elsewhere
+inline vdouble wrapd(vdouble a)
+{
+    auto one = _mm256_set1_pd(1.0);
+    return _mm256_sub_pd(a, _mm256_and_pd(_mm256_cmp_pd(a, one, _CMP_GT_OQ), one));
+}
+// as wrapd, also telling us whether any lane wrapped
+inline vdouble wrapd(vdouble a, bool &wrapped)
+{
+    auto one = _mm256_set1_pd(1.0);
+    auto m = _mm256_cmp_pd(a, one, _CMP_GT_OQ);
+    wrapped = _mm256_movemask_pd(m) != 0;
+    return _mm256_sub_pd(a, _mm256_and_pd(m, one));
+}
+inline double hsumd(vdouble a)
+{
+    auto s = _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+using vfloat = __m256;
+static constexpr int float_lanes = 8;
+
+inline vfloat loadf(const float *p) { return _mm256_loadu_ps(p); }
+inline void storef(float *p, vfloat v) { _mm256_storeu_ps(p, v); }
+inline vfloat set1f(float f) { return _mm256_set1_ps(f); }
+inline vfloat addf(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+inline vfloat subf(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+inline vfloat mulf(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+inline vfloat maxf(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+inline vfloat absf(vfloat a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+// zero in the lanes where |a| < floor, a elsewhere
+inline vfloat flushBelowf(vfloat a, vfloat floor)
+{
+    return _mm256_and_ps(a, _mm256_cmp_ps(absf(a), floor, _CMP_GE_OQ));
+}
+inline float hsumf(vfloat a)
+{
+    auto s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+}
+inline float hmaxf(vfloat a)
+{
+    auto s = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    s = _mm_max_ps(s, _mm_movehl_ps(s, s));
+    return _mm_cvtss_f32(_mm_max_ss(s, _mm_shuffle_ps(s, s, 1)));
+}
+#elif CLAP_SAW_DEMO_SIMD_SSE2
+using vdouble = __m128d;
+static constexpr int double_lanes = 2;
+
+inline vdouble loadd(const double *p) { return _mm_loadu_pd(p); }
+inline void stored(double *p, vdouble v) { _mm_storeu_pd(p, v); }
+inline vdouble set1d(double d) { return _mm_set1_pd(d); }
+inline vdouble addd(vdouble a, vdouble b) { return _mm_add_pd(a, b); }
+inline vdouble subd(vdouble a, vdouble b) { return _mm_sub_pd(a, b); }
+inline vdouble muld(vdouble a, vdouble b) { return _mm_mul_pd(a, b); }
+inline vdouble wrapd(vdouble a)
+{
+    auto one = _mm_set1_pd(1.0);
+    return _mm_sub_pd(a, _mm_and_pd(_mm_cmpgt_pd(a, one), one));
+}
+inline vdouble wrapd(vdouble a, bool &wrapped)
+{
+    auto one = _mm_set1_pd(1.0);
+    auto m = _mm_cmpgt_pd(a, one);
+    wrapped = _mm_movemask_pd(m) != 0;
+    return _mm_sub_pd(a, _mm_and_pd(m, one));
+}
+inline double hsumd(vdouble a) { return _mm_cvtsd_f64(_mm_add_sd(a, _mm_unpackhi_pd(a, a))); }
+
+using vfloat = __m128;
+static constexpr int float_lanes = 4;
+
+inline vfloat loadf(const float *p) { return _mm_loadu_ps(p); }
+inline void storef(float *p, vfloat v) { _mm_storeu_ps(p, v); }
+inline vfloat set1f(float f) { return _mm_set1_ps(f); }
+inline vfloat addf(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+inline vfloat subf(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+inline vfloat mulf(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+inline vfloat maxf(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+inline vfloat absf(vfloat a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+inline vfloat flushBelowf(vfloat a, vfloat floor)
+{
+    return _mm_and_ps(a, _mm_cmpge_ps(absf(a), floor));
+}
+inline float hsumf(vfloat a)
+{
+    auto s = _mm_add_ps(a, _mm_movehl_ps(a, a));
+    return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+}
+inline float hmaxf(vfloat a)
+{
+    auto s = _mm_max_ps(a, _mm_movehl_ps(a, a));
+    return _mm_cvtss_f32(_mm_max_ss(s, _mm_shuffle_ps(s, s, 1)));
+}
+#else
+using vdouble = double;
+static constexpr int double_lanes = 1;
+
+inline vdouble loadd(const double *p) { return *p; }
+inline void stored(double *p, vdouble v) { *p = v; }
+inline vdouble set1d(double d) { return d; }
+inline vdouble addd(vdouble a, vdouble b) { return a + b; }
+inline vdouble subd(vdouble a, vdouble b) { return a - b; }
+inline vdouble muld(vdouble a, vdouble b) { return a * b; }
+inline vdouble wrapd(vdouble a) { return a > 1 ? a - 1 : a; }
+inline vdouble wrapd(vdouble a, bool &wrapped)
+{
+    wrapped = a > 1;
+    return wrapped ? a - 1 : a;
+}
+inline double hsumd(vdouble a) { return a; }
+
+using vfloat = float;
+static constexpr int float_lanes = 1;
+
+inline vfloat loadf(const float *p) { return *p; }
+inline void storef(float *p, vfloat v) { *p = v; }
+inline vfloat set1f(float f) { return f; }
+inline vfloat addf(vfloat a, vfloat b) { return a + b; }
+inline vfloat subf(vfloat a, vfloat b) { return a - b; }
+inline vfloat mulf(vfloat a, vfloat b) { return a * b; }
+inline vfloat maxf(vfloat a, vfloat b) { return a > b ? a : b; }
+inline vfloat absf(vfloat a) { return a < 0 ? -a : a; }
+inline vfloat flushBelowf(vfloat a, vfloat floor) { return absf(a) < floor ? 0.f : a; }
+inline float hsumf(vfloat a) { return a; }
+inline float hmaxf(vfloat a) { return a; }
+#endif
+
+/*
+ * vstereo is a left / right pair of floats in the low half of an SSE register (AVX builds
+ * use SSE for this too), loaded from and stored to interleaved stereo.
+ */
+#if CLAP_SAW_DEMO_SIMD_AVX || CLAP_SAW_DEMO_SIMD_SSE2
+using vstereo = __m128;
+
+inline vstereo loadst(const float *p)
+{
+    return _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64 *>(p));
+}
+inline void storest(float *p, vstereo v) { _mm_storel_pi(reinterpret_cast<__m64 *>(p), v); }
+inline vstereo set1st(float f) { return _mm_set1_ps(f); }
+inline vstereo addst(vstereo a, vstereo b) { return _mm_add_ps(a, b); }
+inline vstereo subst(vstereo a, vstereo b) { return _mm_sub_ps(a, b); }
+inline vstereo mulst(vstereo a, vstereo b) { return _mm_mul_ps(a, b); }
+#else
+struct vstereo
+{
+    float l, r;
+};
+
+inline vstereo loadst(const float *p) { return {p[0], p[1]}; }
+inline void storest(float *p, vstereo v)
+{
+    p[0] = v.l;
+    p[1] = v.r;
+}
+inline vstereo set1st(float f) { return {f, f}; }
+inline vstereo addst(vstereo a, vstereo b) { return {a.l + b.l, a.r + b.r}; }
+inline vstereo subst(vstereo a, vstereo b) { return {a.l - b.l, a.r - b.r}; }
+inline vstereo mulst(vstereo a, vstereo b) { return {a.l * b.l, a.r * b.r}; }
+#endif
+
+// The largest magnitude in p[0, n)
+inline float peakf(const float *p, int n)
+{
+    auto v = set1f(0.f);
+    int i = 0;
+    for (; i + float_lanes <= n; i += float_lanes)
+        v = maxf(v, absf(loadf(p + i)));
+    auto res = hmaxf(v);
+    for (; i < n; ++i)
+    {
+        auto a = p[i] < 0 ? -p[i] : p[i];
+        res = a > res ? a : res;
+    }
+    return res;
+}
+} // namespace sst::clap_saw_demo::simd
+
+#endif // CLAP_SAW_DEMO_SIMD_HELPERS_H
@@ -0,0 +1,148 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_VOICE_ALLOCATOR_H
+#define CLAP_SAW_DEMO_VOICE_ALLOCATOR_H
+
+#include <array>
+#include <cstdint>
+
+namespace sst::clap_saw_demo
+{
+/*
+ * VoiceAllocator hands out voice slots. OFF voices sit on a free stack, so starting a note
+ * is O(1) while there are voices to spare. When there aren't, we steal, and which voice
+ * we steal comes from two queues every sounding voice is kept in:
+ *
+ * - every voice, in the order it started
+ * - the voices which have had their note off, in the order they were released
+ *
+ * OLDEST takes the front of the first. RELEASED_FIRST takes the front of the second,
+ * falling back to the oldest held voice if nothing is releasing. Both queues are intrusive
+ * lists through per-voice slots, so every operation is O(1), allocation free and entirely
+ * deterministic. This is audio thread only state.
+ */
+template <int maxVoices> struct VoiceAllocator
+{
+    enum StealPolicy
+    {
+        RELEASED_FIRST,
+        OLDEST
+    };
+
+    // Nothing is free until the owner has voices to hand out and calls reset
+    VoiceAllocator() { reset(0); }
+
+    // Forget everything, with voices [0, nVoices) free
+    void reset(int nVoices)
+    {
+        // Hand out low indices first, so a quiet session stays at the front of the array
+        for (int i = 0; i < nVoices; ++i)
+            freeVoices[i] = nVoices - 1 - i;
+        freeCount = nVoices;
+        links.fill(Links());
+        started = released = Queue();
+    }
+
+    // A free voice, or -1 if every voice is in use
+    int allocate()
+    {
+        if (freeCount == 0)
+            return -1;
+        return freeVoices[--freeCount];
+    }
+
+    // Pick a sounding voice to steal. Follow with started() when it is restarted.
+    int steal(StealPolicy policy)
+    {
+        auto v = (policy == RELEASED_FIRST && released.head >= 0) ? released.head : started.head;
+        if (v >= 0)
+            stolen++;
+        return v;
+    }
+
+    // The voice has (re)started a note
+    void noteStarted(int v)
+    {
+        unlink(released, v, &Links::releasedNode);
+        unlink(started, v, &Links::startedNode);
+        append(started, v, &Links::startedNode);
+    }
+
+    // The voice's note is released and it is now in its release tail
+    void noteReleased(int v)
+    {
+        if (!links[v].releasedNode.linked)
+            append(released, v, &Links::releasedNode);
+    }
+
+    // The voice has gone OFF and can be handed out again
+    void free(int v)
+    {
+        unlink(released, v, &Links::releasedNode);
+        unlink(started, v, &Links::startedNode);
+        freeVoices[freeCount++] = v;
+    }
+
+    // How many voices we have stolen over our lifetime
+    uint64_t stealCount() const { return stolen; }
+
+  private:
+    struct Node
+    {
+        int next{-1}, prev{-1};
+        bool linked{false};
+    };
+    struct Links
+    {
+        Node startedNode, releasedNode;
+    };
+    struct Queue
+    {
+        int head{-1}, tail{-1};
+    };
+
+    void append(Queue &q, int v, Node Links::*node)
+    {
+        auto &n = links[v].*node;
+        n.next = -1;
+        n.prev = q.tail;
+        if (q.tail >= 0)
+            (links[q.tail].*node).next = v;
+        else
+            q.head = v;
+        q.tail = v;
+        n.linked = true;
+    }
+
+    void unlink(Queue &q, int v, Node Links::*node)
+    {
+        auto &n = links[v].*node;
+        if (!n.linked)
+            return;
+        if (n.prev >= 0)
+            (links[n.prev].*node).next = n.next;
+        else
+            q.head = n.next;
+        if (n.next >= 0)
+            (links[n.next].*node).prev = n.prev;
+        else
+            q.tail = n.prev;
+        n = Node();
+    }
+
+    std::array<int, maxVoices> freeVoices{};
+    int freeCount{0};
+    std::array<Links, maxVoices> links{};
+    Queue started, released;
+    uint64_t stolen{0};
+};
+} // namespace sst::clap_saw_demo
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_VOICE_INDEX_H
+#define CLAP_SAW_DEMO_VOICE_INDEX_H
+
+#include <array>
+#include <cstdint>
+
+namespace sst::clap_saw_demo
+{
+/*
+ * VoiceIndex finds the voices playing a given note_id, or a given port / channel / key
+ * (PCK), without walking every voice. Note offs, polyphonic modulation and note
+ * expressions all address voices one of these two ways, and with MPE the expressions
+ * arrive at control rate for every held note.
+ *
+ * Each lookup is a direct-mapped table of buckets, and each bucket an intrusive doubly
+ * linked list through per-voice next / prev slots, so adding and removing a voice is O(1)
+ * and nothing allocates. More than one voice can share a PCK (a retriggered key while the
+ * last one releases) or note_id, so lookups visit every voice in the bucket which matches.
+ *
+ * This is audio thread only state, kept in step with the active voice list: add a voice
+ * when it starts and remove it when it goes OFF or is stolen.
+ */
+template <int maxVoices> struct VoiceIndex
+{
+    // Power of two bucket counts. A PCK table this size means the only collisions
+    // within a port are keys on channels which differ by 16
+    static constexpr int note_id_buckets = 4 * maxVoices;
+    static constexpr int pck_buckets = 2048;
+    static_assert((note_id_buckets & (note_id_buckets - 1)) == 0);
+
+    VoiceIndex() { clear(); }
+
+    void clear()
+    {
+        noteIdHead.fill(-1);
+        pckHead.fill(-1);
+        indexed.fill(false);
+    }
+
+    void add(int voice, int port, int channel, int key, int noteid)
+    {
+        remove(voice);
+
+        auto &e = entries[voice];
+        e.port = port;
+        e.channel = channel;
+        e.key = key;
+        e.noteid = noteid;
+        indexed[voice] = true;
+
+        link(pckHead[pckBucket(port, channel, key)], voice, e.pckNext, e.pckPrev,
+             &Entry::pckPrev);
+        if (noteid >= 0)
+            link(noteIdHead[noteIdBucket(noteid)], voice, e.noteNext, e.notePrev,
+                 &Entry::notePrev);
+    }
+
+    void remove(int voice)
+    {
+        if (!indexed[voice])
+            return;
+
+        auto &e = entries[voice];
+        unlink(pckHead[pckBucket(e.port, e.channel, e.key)], e.pckNext, e.pckPrev,
+               &Entry::pckNext, &Entry::pckPrev);
+        if (e.noteid >= 0)
+            unlink(noteIdHead[noteIdBucket(e.noteid)], e.noteNext, e.notePrev,
+                   &Entry::noteNext, &Entry::notePrev);
+        indexed[voice] = false;
+    }
+
+    // Call f(voice) for each voice started with this note_id
+    template <typename F> void forEachWithNoteId(int noteid, F &&f) const
+    {
+        if (noteid < 0)
+            return;
+        for (auto v = noteIdHead[noteIdBucket(noteid)]; v >= 0;)
+        {
+            // reading next first means f may remove v from the index
+            auto next = entries[v].noteNext;
+            if (entries[v].noteid == noteid)
+                f(v);
+            v = next;
+        }
+    }
+
+    // Call f(voice) for each voice started on this port / channel / key
+    template <typename F> void forEachWithKey(int port, int channel, int key, F &&f) const
+    {
+        for (auto v = pckHead[pckBucket(port, channel, key)]; v >= 0;)
+        {
+            auto next = entries[v].pckNext;
+            const auto &e = entries[v];
+            if (e.key == key && e.channel == channel && e.port == port)
+                f(v);
+            v = next;
+        }
+    }
+
+  private:
+    struct Entry
+    {
+        int port{0}, channel{0}, key{0}, noteid{-1};
+        int pckNext{-1}, pckPrev{-1}, noteNext{-1}, notePrev{-1};
+    };
+
+    static int noteIdBucket(int noteid) { return noteid & (note_id_buckets - 1); }
+    static int pckBucket(int port, int channel, int key)
+    {
+        auto h = (uint32_t)key + 128U * (uint32_t)channel + 2039U * (uint32_t)port;
+        return (int)(h & (pck_buckets - 1));
+    }
+
+    // Push voice onto the front of the list at head
+    void link(int &head, int voice, int &next, int &prev, int Entry::*prevOf)
+    {
+        next = head;
+        prev = -1;
+        if (head >= 0)
+            entries[head].*prevOf = voice;
+        head = voice;
+    }
+
+    void unlink(int &head, int &next, int &prev, int Entry::*nextOf, int Entry::*prevOf)
+    {
+        if (prev >= 0)
+            entries[prev].*nextOf = next;
+        else
+            head = next;
+        if (next >= 0)
+            entries[next].*prevOf = prev;
+        next = prev = -1;
+    }
+
+    std::array<Entry, maxVoices> entries{};
+    std::array<bool, maxVoices> indexed{};
+    std::array<int, note_id_buckets> noteIdHead{};
+    std::array<int, pck_buckets> pckHead{};
+};
+} // namespace sst::clap_saw_demo
+
+#endif
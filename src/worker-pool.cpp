@@ -0,0 +1,233 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#include "worker-pool.h"
+#include "simd-helpers.h"
+#include <algorithm>
+
+namespace sst::clap_saw_demo
+{
+namespace
+{
+// A hint that we are busy waiting, so a hyperthread sibling gets the core
+inline void cpuRelax()
+{
+#if CLAP_SAW_DEMO_SIMD_AVX || CLAP_SAW_DEMO_SIMD_SSE2
+    _mm_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+} // namespace
+
+bool WorkerPool::Job::pop(uint32_t &task)
+{
+    auto b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto t = top.load(std::memory_order_relaxed);
+
+    if (t > b)
+    {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    task = tasks[b & (max_tasks - 1)].load(std::memory_order_relaxed);
+    if (t < b)
+        return true;
+
+    // The last task, which a thief may be after too
+    auto won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                           std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return won;
+}
+
+bool WorkerPool::Job::steal(uint32_t &task)
+{
+    auto t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto b = bottom.load(std::memory_order_acquire);
+    if (t >= b)
+        return false;
+
+    task = tasks[t & (max_tasks - 1)].load(std::memory_order_relaxed);
+    return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed);
+}
+
+std::shared_ptr<WorkerPool> WorkerPool::acquire()
+{
+    static std::mutex sharedMutex;
+    static std::weak_ptr<WorkerPool> shared;
+
+    std::lock_guard<std::mutex> g(sharedMutex);
+    auto res = shared.lock();
+    if (!res)
+    {
+        // On a single core a worker could only take time from the audio thread, so we
+        // have none and run does all the work. If the core count is unknown we guess two.
+        auto cores = (int)std::thread::hardware_concurrency();
+        if (cores <= 0)
+            cores = 2;
+        res = std::shared_ptr<WorkerPool>(new WorkerPool(cores - 1));
+        shared = res;
+    }
+    return res;
+}
+
+WorkerPool::WorkerPool(int nWorkers)
+{
+    workers.reserve(nWorkers);
+    for (int i = 0; i < nWorkers; ++i)
+        workers.emplace_back([this]() { workerLoop(); });
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> g(parkMutex);
+        stopping = true;
+    }
+    parkCV.notify_all();
+    for (auto &w : workers)
+        w.join();
+}
+
+bool WorkerPool::registerJob(Job &job)
+{
+    for (int s = 0; s < max_jobs; ++s)
+    {
+        Job *expected{nullptr};
+        if (jobs[s].compare_exchange_strong(expected, &job))
+        {
+            job.slot = s;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkerPool::unregisterJob(Job &job)
+{
+    if (job.slot < 0)
+        return;
+
+    // Once a worker can no longer find the job, wait out any which already had
+    jobs[job.slot] = nullptr;
+    while (visitors[job.slot] != 0)
+        std::this_thread::yield();
+    job.slot = -1;
+}
+
+bool WorkerPool::run(Job &job, uint32_t nTasks, taskFn_t fn, void *ctx)
+{
+    if (job.slot < 0 || nTasks > max_tasks)
+        return false;
+
+    auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+    runInterval.store(now - lastRun.exchange(now, std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+
+    job.fn = fn;
+    job.ctx = ctx;
+    job.remaining.store(nTasks, std::memory_order_relaxed);
+    job.epoch.store(runEpoch.fetch_add(1, std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+
+    // Push them all, then publish them with a single move of bottom. Pushing in reverse
+    // means we pop task 0 first and the thieves start from the other end.
+    auto b = job.bottom.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < nTasks; ++i)
+        job.tasks[(b + i) & (max_tasks - 1)].store(nTasks - 1 - i, std::memory_order_relaxed);
+    job.bottom.store(b + nTasks, std::memory_order_release);
+
+    running.fetch_add(1);
+    if (parked.load(std::memory_order_relaxed) > 0)
+        parkCV.notify_all();
+
+    uint32_t task;
+    while (job.pop(task))
+    {
+        fn(ctx, task);
+        job.remaining.fetch_sub(1, std::memory_order_release);
+    }
+    while (job.remaining.load(std::memory_order_acquire) != 0)
+        cpuRelax();
+
+    running.fetch_sub(1);
+    return true;
+}
+
+bool WorkerPool::stealAndRun(int &slot, uint64_t joinFrom)
+{
+    for (int i = 0; i < max_jobs; ++i)
+    {
+        auto s = (slot + i) % max_jobs;
+        visitors[s].fetch_add(1);
+        auto *job = jobs[s].load();
+        uint32_t task;
+        if (job && job->epoch.load(std::memory_order_relaxed) >= joinFrom && job->steal(task))
+        {
+            job->fn(job->ctx, task);
+            job->remaining.fetch_sub(1, std::memory_order_release);
+            visitors[s].fetch_sub(1);
+            slot = s;
+            return true;
+        }
+        visitors[s].fetch_sub(1);
+    }
+    return false;
+}
+
+std::chrono::steady_clock::time_point WorkerPool::spinDeadline() const
+{
+    using clock = std::chrono::steady_clock;
+    auto interval = std::min(clock::duration(runInterval.load(std::memory_order_relaxed)),
+                             clock::duration(max_spin_time));
+    auto last = clock::time_point(clock::duration(lastRun.load(std::memory_order_relaxed)));
+    return std::max(last + 2 * interval, clock::now() + spin_time);
+}
+
+void WorkerPool::workerLoop()
+{
+    int slot{0};
+
+    // Runs before this one started before we woke, so we leave them to their owners
+    uint64_t joinFrom{0};
+
+    while (!stopping)
+    {
+        if (running.load(std::memory_order_relaxed) > 0 && stealAndRun(slot, joinFrom))
+            continue;
+
+        bool found{false};
+        auto spinUntil = spinDeadline();
+        while (!found && std::chrono::steady_clock::now() < spinUntil)
+        {
+            for (int i = 0; i < 64 && !found; ++i)
+            {
+                found = running.load(std::memory_order_relaxed) > 0;
+                cpuRelax();
+            }
+        }
+        if (found)
+            continue;
+
+        std::unique_lock<std::mutex> lk(parkMutex);
+        if (stopping)
+            break;
+        parked++;
+        parkCV.wait_for(lk, park_time);
+        parked--;
+        joinFrom = runEpoch.load(std::memory_order_relaxed) + 1;
+    }
+}
+} // namespace sst::clap_saw_demo
@@ -0,0 +1,118 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_WORKER_POOL_H
+#define CLAP_SAW_DEMO_WORKER_POOL_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sst::clap_saw_demo
+{
+/*
+ * WorkerPool is our own thread pool, for hosts which don't give us clap_host_thread_pool.
+ * There is one per process, shared by every instance which opts in, with a worker for
+ * each core but one (the audio thread is the other), so none at all on a single core. So however many instances use it,
+ * they never oversubscribe the machine. acquire() makes it on first use and it goes away
+ * with the last shared_ptr.
+ *
+ * An instance registers a Job once, at activate, and then calls run from its audio
+ * thread. run pushes the tasks onto the job's work-stealing deque and works through them
+ * from the bottom while the workers steal from the top, then waits for any stolen tasks
+ * still running. It neither allocates nor locks.
+ *
+ * Idle workers spin looking for work and then park. While runs keep coming they spin
+ * until twice the last interval between runs has gone by since the latest one, so in a
+ * steady stream of blocks they are always spinning when the next run starts, and run
+ * never has to make a syscall to wake them. That interval is capped at max_spin_time, so
+ * once the host stops processing they park soon after, and they always spin at least
+ * spin_time.
+ *
+ * run wakes parked workers, but without taking the lock (so a wake can be missed), which
+ * is why they also wake every park_time on their own. A worker which has just woken sits
+ * out any run already under way and joins from the next one. The audio thread will have
+ * got well into the tasks by then, and a late thief would only leave it waiting for a
+ * task it could have run itself.
+ */
+struct WorkerPool
+{
+    static constexpr int max_jobs = 64;
+    static constexpr uint32_t max_tasks = 256; // a power of two
+    static constexpr auto spin_time = std::chrono::microseconds(200);
+    static constexpr auto max_spin_time = std::chrono::milliseconds(50);
+    static constexpr auto park_time = std::chrono::milliseconds(2);
+
+    typedef void (*taskFn_t)(void *ctx, uint32_t taskIndex);
+
+    /*
+     * A Chase-Lev deque of task indices. The owner pushes and pops at the bottom and
+     * everyone else steals from the top. The indices only ever grow, so a thief which
+     * read a slot from an earlier run will always lose its compare-exchange on top.
+     */
+    struct Job
+    {
+        std::atomic<int64_t> top{0}, bottom{0};
+        std::array<std::atomic<uint32_t>, max_tasks> tasks{};
+        std::atomic<uint32_t> remaining{0};
+
+        // Written by the owner before the tasks are pushed
+        taskFn_t fn{nullptr};
+        void *ctx{nullptr};
+        std::atomic<uint64_t> epoch{0}; // which run, counted across the whole pool
+
+        int slot{-1};
+
+        bool pop(uint32_t &task);
+        bool steal(uint32_t &task);
+    };
+
+    static std::shared_ptr<WorkerPool> acquire();
+    ~WorkerPool();
+
+    // Register on the main thread before calling run, and unregister before the job goes
+    // away. registerJob fails if max_jobs instances are already registered.
+    bool registerJob(Job &job);
+    void unregisterJob(Job &job);
+
+    // Runs fn(ctx, i) for i in [0, nTasks) and returns once they are all done, or
+    // returns false having run nothing if the job isn't registered or nTasks is too big
+    bool run(Job &job, uint32_t nTasks, taskFn_t fn, void *ctx);
+
+    int workerCount() const { return (int)workers.size(); }
+
+  private:
+    explicit WorkerPool(int nWorkers);
+    void workerLoop();
+    bool stealAndRun(int &slot, uint64_t joinFrom);
+    std::chrono::steady_clock::time_point spinDeadline() const;
+
+    std::array<std::atomic<Job *>, max_jobs> jobs{};
+    std::array<std::atomic<int>, max_jobs> visitors{};
+    std::atomic<int> running{0};
+    std::atomic<uint64_t> runEpoch{0};
+
+    // When the latest run started, and how long after the one before, in steady_clock ticks
+    std::atomic<int64_t> lastRun{0}, runInterval{0};
+
+    std::vector<std::thread> workers;
+    std::atomic<bool> stopping{false};
+    std::atomic<int> parked{0};
+    std::mutex parkMutex;
+    std::condition_variable parkCV;
+};
+} // namespace sst::clap_saw_demo
+
+#endif // CLAP_SAW_DEMO_WORKER_POOL_H
@@ -0,0 +1,158 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <optional>
+#include "saw-voice.h"
+#include "denormals.h"
+
+using sst::clap_saw_demo::SawDemoVoice;
+using sst::clap_saw_demo::SawWavetable;
+using sst::clap_saw_demo::ScopedFlushDenormals;
+
+/*
+ * Render a full house of held voices with each oscillator engine and report the
+ * cost per voice per sample. This isn't a test and has no pass or fail; it is here
+ * so changes to the kernels can be measured.
+ */
+struct Engine
+{
+    const char *name;
+    int oscEngine;
+    bool statefulDPW;
+};
+
+static double nsPerVoiceSample(const Engine &e, int unison, int nvoices)
+{
+    static constexpr int block = 256, blocks = 400;
+
+    std::vector<SawDemoVoice> voices(nvoices);
+    for (int i = 0; i < nvoices; ++i)
+    {
+        auto &v = voices[i];
+        v.unison = unison;
+        v.oscEngine = e.oscEngine;
+        v.statefulDPW = e.statefulDPW;
+        v.wavetable = &SawWavetable::instance();
+        v.ampRelease = 1000;
+        v.sampleRate = 48000;
+        v.start(36 + (i * 7) % 60);
+    }
+
+    std::vector<float> L(block), R(block);
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (int b = 0; b < blocks; ++b)
+    {
+        std::fill(L.begin(), L.end(), 0.f);
+        std::fill(R.begin(), R.end(), 0.f);
+        for (auto &v : voices)
+            v.renderBlock(L.data(), R.data(), block);
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    // Keep the optimizer from throwing the work away
+    volatile float sink = L[block / 2] + R[block / 3];
+    (void)sink;
+
+    auto ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    return ns / (double(blocks) * block * nvoices);
+}
+
+/*
+ * A held pad with its VCA at zero, so its filters only decay. We start the filter state
+ * just above the denormal range and time the tail. The bare filter kernel is how the
+ * voice ran before it flushed its filter state; the voice itself flushes every chunk.
+ * Each is timed with FTZ/DAZ off and on.
+ */
+static double nsSilentTail(bool wholeVoice, bool flushDenormals, int nvoices)
+{
+    static constexpr int block = 256, blocks = 400;
+
+    std::vector<SawDemoVoice> voices(nvoices);
+    for (int i = 0; i < nvoices; ++i)
+    {
+        auto &v = voices[i];
+        v.unison = 1;
+        v.preFilterVCA = 0;
+        v.cutoff = 20 + i;
+        v.res = 0.9;
+        v.ampRelease = 1000;
+        v.sampleRate = 48000;
+        v.start(36 + (i * 7) % 60);
+        for (int c = 0; c < 2; ++c)
+        {
+            v.filter.ic1eq[c] = (c ? -1e-36f : 1e-36f) * (1 + i);
+            v.filter.ic2eq[c] = 2e-36f * (1 + i);
+        }
+    }
+
+    std::vector<float> L(block), R(block), LR(2 * block);
+    std::optional<ScopedFlushDenormals> ftz;
+    if (flushDenormals)
+        ftz.emplace();
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (int b = 0; b < blocks; ++b)
+    {
+        std::fill(L.begin(), L.end(), 0.f);
+        std::fill(R.begin(), R.end(), 0.f);
+        for (auto &v : voices)
+        {
+            if (wholeVoice)
+            {
+                v.renderBlock(L.data(), R.data(), block);
+            }
+            else
+            {
+                std::fill(LR.begin(), LR.end(), 0.f);
+                v.filter.processFn(v.filter, LR.data(), block);
+                L[0] += LR[0];
+            }
+        }
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+    ftz.reset();
+
+    volatile float sink = L[0] + R[block / 3];
+    (void)sink;
+
+    auto ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    return ns / (double(blocks) * block * nvoices);
+}
+
+int main(int argc, char *argv[])
+{
+    const Engine engines[] = {{"DPW (direct)", SawDemoVoice::OSC_DPW, false},
+                              {"DPW (stateful)", SawDemoVoice::OSC_DPW, true},
+                              {"Wavetable (linear)", SawDemoVoice::OSC_WAVETABLE_LINEAR, true},
+                              {"Wavetable (cubic)", SawDemoVoice::OSC_WAVETABLE_CUBIC, true}};
+
+    std::cout << "ns per voice per sample, 32 voices" << std::endl;
+    std::cout << std::setw(20) << "unison";
+    for (int uni : {1, 3, 7})
+        std::cout << std::setw(10) << uni;
+    std::cout << std::endl;
+
+    for (const auto &e : engines)
+    {
+        std::cout << std::setw(20) << e.name;
+        for (int uni : {1, 3, 7})
+            std::cout << std::setw(10) << std::fixed << std::setprecision(2)
+                      << nsPerVoiceSample(e, uni, 32);
+        std::cout << std::endl;
+    }
+
+    std::cout << std::endl << "ns per voice per sample, 32 silent voices" << std::endl;
+    std::cout << std::setw(20) << "FTZ/DAZ" << std::setw(10) << "off" << std::setw(10) << "on"
+              << std::endl;
+    for (int whole = 0; whole < 2; ++whole)
+    {
+        std::cout << std::setw(20) << (whole ? "Voice (flushed)" : "Bare filter");
+        for (bool ftz : {false, true})
+            std::cout << std::setw(10) << std::fixed << std::setprecision(2)
+                      << nsSilentTail(whole, ftz, 32);
+        std::cout << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,265 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <dlfcn.h>
+#include <clap/clap.h>
+
+/*
+ * Renders the same notes through three instances of the plugin: one on a host with a
+ * thread pool, one on a host without, and one on a host without but with the plugin's
+ * own Internal Threads turned on. Checks the output is bit-identical. Enough notes are
+ * played that the plugin splits its voices into thread pool tasks. We do it all again
+ * oversampled, where the tasks render at the higher rate.
+ */
+
+// The plugin the pool host is currently processing, and how many times it used the pool
+static const clap_plugin_t *pool_plugin{nullptr};
+static std::atomic<int> pool_requests{0};
+
+// A local stand-in for a host thread pool: run each task on its own thread and wait
+static bool pool_request_exec(const clap_host *, uint32_t num_tasks)
+{
+    auto ext = (const clap_plugin_thread_pool_t *)pool_plugin->get_extension(pool_plugin,
+                                                                              CLAP_EXT_THREAD_POOL);
+    if (!ext)
+        return false;
+
+    std::vector<std::thread> workers;
+    for (uint32_t t = 0; t < num_tasks; ++t)
+        workers.emplace_back([ext, t]() { ext->exec(pool_plugin, t); });
+    for (auto &w : workers)
+        w.join();
+    pool_requests++;
+    return true;
+}
+
+static const clap_host_thread_pool_t host_thread_pool = {pool_request_exec};
+
+static const void *pool_get_extension(const clap_host *, const char *id)
+{
+    if (strcmp(id, CLAP_EXT_THREAD_POOL) == 0)
+        return &host_thread_pool;
+    return nullptr;
+}
+static const void *no_get_extension(const clap_host *, const char *) { return nullptr; }
+static void host_request(const clap_host *) {}
+
+static const clap_host serial_host = {
+    CLAP_VERSION,
+    nullptr, // host_data
+    "Test Host",  "Test", "http://test.com", "1.0.0",
+    no_get_extension,
+    host_request, // request_restart
+    host_request, // request_process
+    host_request, // request_callback
+};
+
+static const clap_host pool_host = {
+    CLAP_VERSION,
+    nullptr, // host_data
+    "Test Host",  "Test", "http://test.com", "1.0.0",
+    pool_get_extension,
+    host_request, // request_restart
+    host_request, // request_process
+    host_request, // request_callback
+};
+
+// A fixed list of input events for one block
+struct EventList
+{
+    std::vector<clap_event_note> notes;
+    clap_input_events in{this, size, get};
+
+    static uint32_t size(const clap_input_events *list)
+    {
+        return (uint32_t)((EventList *)list->ctx)->notes.size();
+    }
+    static const clap_event_header_t *get(const clap_input_events *list, uint32_t index)
+    {
+        return &((EventList *)list->ctx)->notes[index].header;
+    }
+};
+
+static bool try_push(const clap_output_events *, const clap_event_header_t *) { return true; }
+static const clap_output_events out_events = {nullptr, try_push};
+
+static clap_event_note make_note(uint16_t type, int key, uint32_t time)
+{
+    clap_event_note n{};
+    n.header.size = sizeof(clap_event_note);
+    n.header.type = type;
+    n.header.time = time;
+    n.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+    n.note_id = -1;
+    n.port_index = 0;
+    n.channel = 0;
+    n.key = key;
+    n.velocity = 1.0;
+    return n;
+}
+
+// Sets a parameter through params flush, which is how a host would before activating
+static void set_param(const clap_plugin_t *plugin, clap_id id, double value)
+{
+    auto params = (const clap_plugin_params_t *)plugin->get_extension(plugin, CLAP_EXT_PARAMS);
+    if (!params)
+        return;
+
+    clap_event_param_value pv{};
+    pv.header.size = sizeof(clap_event_param_value);
+    pv.header.type = CLAP_EVENT_PARAM_VALUE;
+    pv.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+    pv.param_id = id;
+    pv.note_id = -1;
+    pv.port_index = -1;
+    pv.channel = -1;
+    pv.key = -1;
+    pv.value = value;
+
+    clap_input_events in{&pv, [](const clap_input_events *) -> uint32_t { return 1; },
+                         [](const clap_input_events *list, uint32_t) {
+                             return (const clap_event_header_t *)list->ctx;
+                         }};
+    params->flush(plugin, &in, &out_events);
+}
+
+// ClapSawDemo::pmInternalThreads and pmOversampling
+static const clap_id internal_threads_param = 7230;
+static const clap_id oversampling_param = 9147;
+
+static const int num_notes = 60;
+static const int num_blocks = 40;
+static const uint32_t block_size = 256;
+
+// Plays num_notes notes, releases half of them part way through, and returns the output
+static std::vector<float> render(const clap_plugin_factory_t *factory, const char *id,
+                                 const clap_host *host, double oversampling,
+                                 bool internal_threads = false)
+{
+    std::vector<float> result;
+
+    const clap_plugin_t *plugin = factory->create_plugin(factory, host, id);
+    if (!plugin || !plugin->init(plugin))
+        return result;
+
+    pool_plugin = plugin;
+    set_param(plugin, oversampling_param, oversampling);
+    if (internal_threads)
+        set_param(plugin, internal_threads_param, 1.0);
+    if (!plugin->activate(plugin, 48000, 1, block_size) || !plugin->start_processing(plugin))
+    {
+        plugin->destroy(plugin);
+        return result;
+    }
+
+    std::vector<float> L(block_size), R(block_size);
+    float *data[2] = {L.data(), R.data()};
+    clap_audio_buffer_t output{};
+    output.data32 = data;
+    output.channel_count = 2;
+
+    for (int b = 0; b < num_blocks; ++b)
+    {
+        EventList events;
+        if (b == 0)
+            for (int k = 0; k < num_notes; ++k)
+                events.notes.push_back(make_note(CLAP_EVENT_NOTE_ON, 30 + k, k * 3));
+        if (b == num_blocks / 2)
+            for (int k = 0; k < num_notes; k += 2)
+                events.notes.push_back(make_note(CLAP_EVENT_NOTE_OFF, 30 + k, k));
+
+        clap_process_t process{};
+        process.frames_count = block_size;
+        process.steady_time = -1;
+        process.audio_outputs = &output;
+        process.audio_outputs_count = 1;
+        process.in_events = &events.in;
+        process.out_events = &out_events;
+        plugin->process(plugin, &process);
+
+        result.insert(result.end(), L.begin(), L.end());
+        result.insert(result.end(), R.begin(), R.end());
+    }
+
+    plugin->stop_processing(plugin);
+    plugin->deactivate(plugin);
+    plugin->destroy(plugin);
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    std::cout << "Starting thread pool test..." << std::endl;
+
+    const char *plugin_path = "clap-saw-demo-ftxui.clap/Contents/MacOS/clap-saw-demo-ftxui";
+    if (argc > 1)
+    {
+        plugin_path = argv[1];
+    }
+
+    void *handle = dlopen(plugin_path, RTLD_LAZY);
+    if (!handle)
+    {
+        std::cerr << "Cannot load plugin from " << plugin_path << ": " << dlerror() << std::endl;
+        return 1;
+    }
+
+    const clap_plugin_entry_t *entry = (const clap_plugin_entry_t *)dlsym(handle, "clap_entry");
+    if (!entry || !entry->init("/tmp"))
+    {
+        std::cerr << "Cannot initialize plugin entry" << std::endl;
+        dlclose(handle);
+        return 1;
+    }
+
+    const clap_plugin_factory_t *factory =
+        (const clap_plugin_factory_t *)entry->get_factory(CLAP_PLUGIN_FACTORY_ID);
+    const clap_plugin_descriptor_t *desc = factory->get_plugin_descriptor(factory, 0);
+
+    int result = 0;
+    for (double oversampling : {0.0, 2.0})
+    {
+        pool_requests = 0;
+        auto serial = render(factory, desc->id, &serial_host, oversampling);
+        auto pooled = render(factory, desc->id, &pool_host, oversampling);
+        auto internal = render(factory, desc->id, &serial_host, oversampling, true);
+
+        if (serial.empty() || serial.size() != pooled.size() || serial.size() != internal.size())
+        {
+            std::cerr << "Could not render through both hosts" << std::endl;
+            result = 1;
+        }
+        else if (pool_requests == 0)
+        {
+            std::cerr << "The plugin never used the host thread pool" << std::endl;
+            result = 1;
+        }
+        else if (memcmp(serial.data(), pooled.data(), serial.size() * sizeof(float)) != 0)
+        {
+            std::cerr << "Thread pool output differs from the serial output" << std::endl;
+            result = 1;
+        }
+        else if (memcmp(serial.data(), internal.data(), serial.size() * sizeof(float)) != 0)
+        {
+            std::cerr << "Internal thread output differs from the serial output" << std::endl;
+            result = 1;
+        }
+        else
+        {
+            std::cout << "Oversampling " << oversampling << ": host thread pool used "
+                      << pool_requests
+                      << " times; host pool, internal threads and serial output are "
+                         "bit-identical"
+                      << std::endl;
+        }
+    }
+
+    entry->deinit();
+    dlclose(handle);
+
+    if (result == 0)
+        std::cout << "Thread pool test completed successfully!" << std::endl;
+    return result;
+}
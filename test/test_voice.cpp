@@ -0,0 +1,904 @@
+#include <iostream>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "saw-voice.h"
+#include "saw-voice-bank.h"
+#include "fast-math.h"
+#include "halfband-decimator.h"
+
+using sst::clap_saw_demo::SawDemoVoice;
+using sst::clap_saw_demo::SawDemoVoiceBank;
+using sst::clap_saw_demo::SawWavetable;
+using sst::clap_saw_demo::StereoDecimator;
+
+/*
+ * ReferenceVoice is the original one-sample-at-a-time, one-oscillator-at-a-time
+ * SawDemoVoice::step, kept here as the golden model the optimized kernels are
+ * checked against.
+ */
+struct ReferenceVoice
+{
+    int unison{3};
+    float uniSpread{10.0}, oscDetune{0};
+    int filterMode{0};
+    float cutoff{69.0}, res{0.7};
+    bool ampGate{false};
+    float ampAttack{0.01}, ampRelease{0.1};
+    float preFilterVCA{1.0};
+    float sampleRate{48000};
+    int key{60};
+
+    SawDemoVoice::AEGMode state{SawDemoVoice::OFF};
+    float L{0.f}, R{0.f};
+
+    double baseFreq{440.0}, srInv{1.0 / 48000.0};
+    float time{0}, releaseFrom{1.0};
+    float panL[7], panR[7], unitShift[7], norm[7];
+    double phase[7], dPhase[7], dPhaseInv[7];
+
+    float ic1eq[2]{0, 0}, ic2eq[2]{0, 0};
+    float k{0}, a1{0}, a2{0}, a3{0}, ak{0};
+
+    void start(int startKey)
+    {
+        const float pival = 3.14159265358979323846;
+        srInv = 1.0 / sampleRate;
+        key = startKey;
+        state = (ampAttack > 0 ? SawDemoVoice::ATTACK : SawDemoVoice::HOLD);
+        time = 0;
+        if (unison == 1)
+        {
+            unitShift[0] = 0;
+            panL[0] = 1;
+            panR[0] = 1;
+            phase[0] = 0.0;
+            norm[0] = 1.0;
+        }
+        else
+        {
+            for (int i = 0; i < unison; ++i)
+            {
+                float dI = 1.0 * i / (unison - 1);
+                unitShift[i] = 2 * dI - 1;
+                phase[i] = dI;
+                panL[i] = std::cos(0.5 * pival * dI);
+                panR[i] = std::sin(0.5 * pival * dI);
+                norm[i] = 1.0 / sqrt(unison);
+            }
+        }
+
+        baseFreq = 440.0 * pow(2.0, ((key + oscDetune / 100) - 69.0) / 12.0);
+        for (int i = 0; i < unison; ++i)
+        {
+            dPhase[i] = (baseFreq * pow(2.0, uniSpread * unitShift[i] / 100.0 / 12.0)) / sampleRate;
+            dPhaseInv[i] = 1.0 / dPhase[i];
+        }
+
+        auto co = 440.0 * pow(2.0, (cutoff - 69.0) / 12);
+        co = std::clamp(co, 10.0, 15000.0);
+        auto rs = std::clamp(res, 0.01f, 0.99f);
+        float g = std::tan(pival * co * srInv);
+        k = 2.0 - 2.0 * rs;
+        float gk = g + k;
+        a1 = 1.0 / (1.0 + g * gk);
+        a2 = g * a1;
+        a3 = g * a2;
+        ak = gk * a1;
+    }
+
+    void release()
+    {
+        state = SawDemoVoice::RELEASING;
+        time = 0;
+    }
+
+    void step()
+    {
+        float AR = 1.0;
+        if (state == SawDemoVoice::ATTACK)
+        {
+            AR = time / ampAttack;
+            releaseFrom = AR;
+            time += srInv;
+            if (time >= ampAttack)
+                state = SawDemoVoice::HOLD;
+            if (ampGate)
+                AR = 1.0;
+        }
+        else if (state == SawDemoVoice::RELEASING)
+        {
+            auto tn = time / ampRelease;
+            AR = releaseFrom * (1.0 - tn);
+            time += srInv;
+            if (time >= ampRelease)
+                state = SawDemoVoice::NEWLY_OFF;
+            if (ampGate)
+            {
+                AR = 1.0;
+                if (tn > 0.98)
+                    AR = 1 - (tn - 0.98) / 0.02;
+            }
+        }
+        else if (state == SawDemoVoice::HOLD)
+        {
+            AR = 1.0;
+            time = 0;
+            releaseFrom = 1.0;
+        }
+
+        AR *= preFilterVCA;
+        L = 0;
+        R = 0;
+        for (int i = 0; i < unison; ++i)
+        {
+            double phaseSteps[3];
+            for (int q = -2; q <= 0; ++q)
+            {
+                double ph = phase[i] + q * dPhase[i];
+                ph = ph * 2 - 1;
+                phaseSteps[q + 2] = (ph * ph - 1) * ph / 6.0;
+            }
+            double saw = (phaseSteps[0] + phaseSteps[2] - 2 * phaseSteps[1]) * 0.25 *
+                         dPhaseInv[i] * dPhaseInv[i];
+            L += 0.2 * norm[i] * AR * panL[i] * saw;
+            R += 0.2 * norm[i] * AR * panR[i] * saw;
+            phase[i] += dPhase[i];
+            if (phase[i] > 1)
+                phase[i] -= 1;
+        }
+
+        float vin[2]{L, R}, out[2];
+        for (int c = 0; c < 2; ++c)
+        {
+            auto v3 = vin[c] - ic2eq[c];
+            auto v0 = a1 * v3 - ak * ic1eq[c];
+            auto v1 = a2 * v3 + a1 * ic1eq[c];
+            auto v2 = a3 * v3 + a2 * ic1eq[c] + ic2eq[c];
+            ic1eq[c] = 2 * v1 - ic1eq[c];
+            ic2eq[c] = 2 * v2 - ic2eq[c];
+            float r[6] = {v2, v0, v1, v2 + v0, v2 - v0, v2 + v0 - k * v1};
+            out[c] = r[filterMode];
+        }
+        L = out[0];
+        R = out[1];
+    }
+};
+
+// How far the optimized kernels may drift from the reference, on a roughly unit scale signal
+static constexpr float tolerance = 1e-5;
+
+// The bank runs the voice's own kernels, so it agrees with per voice rendering to rounding
+static constexpr float bank_tolerance = 1e-6;
+
+// How many samples the voice gives a segment: the first sample count whose time, worked
+// out afresh rather than accumulated, reaches the segment's length
+static int segmentSamples(float seconds, double srInv)
+{
+    int n = 1;
+    while ((float)(n * srInv) < seconds)
+        ++n;
+    return n;
+}
+
+/*
+ * The reference times its envelope segments by adding srInv to a float each sample, as the
+ * original voice did. That drifts far enough over a long segment to end it a sample late,
+ * where the voice counts samples and ends it on time. So we check the voice ends within a
+ * sample of the reference, skip the sample only one of them plays, and close to a segment
+ * end (through the whole last 2% fade, gated), where the two envelopes may be a sample
+ * apart, allow one sample's envelope movement at the reference's peak level instead of the
+ * tolerance. checkSegmentEnds pins down the voice's own segment lengths.
+ */
+static bool compareWithReference(int unison, int filterMode, bool gate, int key, bool stateful)
+{
+    ReferenceVoice ref;
+    SawDemoVoice v;
+
+    v.statefulDPW = stateful;
+    ref.unison = v.unison = unison;
+    ref.filterMode = v.filterMode = filterMode;
+    ref.ampGate = v.ampGate = gate;
+    ref.ampAttack = v.ampAttack = 0.01;
+    ref.ampRelease = v.ampRelease = 0.05;
+    ref.cutoff = v.cutoff = 90;
+    ref.res = v.res = 0.5;
+    ref.sampleRate = v.sampleRate = 48000;
+
+    ref.start(key);
+    v.start(key);
+
+    // Every sample of both, and where each segment ended: the last sample of the attack in
+    // the reference, the last sounding sample of each, and the block the voice's fell in
+    std::vector<float> refOut, voiceOut;
+    int refAttackEnd{-1}, refOff{-1}, releasedAt{-1}, voiceOffFrom{-1}, voiceOffTo{-1};
+
+    std::vector<float> L(64), R(64);
+    for (int blk = 0; blk < 200; ++blk)
+    {
+        if (blk == 100)
+        {
+            ref.release();
+            v.release();
+            releasedAt = (int)refOut.size() / 2;
+        }
+
+        // deliberately awkward block sizes
+        int bs = 1 + (blk * 7) % 64;
+        std::fill(L.begin(), L.end(), 0.f);
+        std::fill(R.begin(), R.end(), 0.f);
+        auto wasPlaying = v.isPlaying();
+        if (wasPlaying)
+            v.renderBlock(L.data(), R.data(), bs);
+        if (wasPlaying && v.state == SawDemoVoice::NEWLY_OFF)
+        {
+            voiceOffFrom = (int)refOut.size() / 2;
+            voiceOffTo = voiceOffFrom + bs - 1;
+        }
+
+        for (int i = 0; i < bs; ++i)
+        {
+            float rl = 0, rr = 0;
+            if (ref.state != SawDemoVoice::OFF && ref.state != SawDemoVoice::NEWLY_OFF)
+            {
+                auto was = ref.state;
+                ref.step();
+                rl = ref.L;
+                rr = ref.R;
+
+                auto t = (int)refOut.size() / 2;
+                if (was == SawDemoVoice::ATTACK && ref.state != SawDemoVoice::ATTACK)
+                    refAttackEnd = t;
+                if (ref.state == SawDemoVoice::NEWLY_OFF)
+                    refOff = t;
+            }
+            refOut.insert(refOut.end(), {rl, rr});
+            voiceOut.insert(voiceOut.end(), {L[i], R[i]});
+        }
+    }
+
+    auto voiceOff = releasedAt + segmentSamples(v.ampRelease, 1.0 / v.sampleRate) - 1;
+    if (voiceOff < voiceOffFrom || voiceOff > voiceOffTo || std::abs(voiceOff - refOff) > 1)
+    {
+        std::cerr << "Voice termination differs from reference by more than a sample"
+                  << " (unison=" << unison << " mode=" << filterMode << ")" << std::endl;
+        return false;
+    }
+
+    // The two envelopes' steepest step per sample near each segment end, and how far
+    // before the end they can be apart
+    auto sr = ref.sampleRate;
+    auto attackStep = 1.0 / (ref.ampAttack * sr), releaseStep = 1.0 / (ref.ampRelease * sr);
+    auto fade = (int)std::ceil(0.02 * ref.ampRelease * sr);
+    if (gate)
+        releaseStep = 1.0 / fade;
+
+    float peak{0};
+    for (auto x : refOut)
+        peak = std::max(peak, std::fabs(x));
+
+    float worst{0}, worstNearEnd{0};
+    for (int i = 0; i < (int)refOut.size(); ++i)
+    {
+        auto t = i / 2;
+        auto d = std::fabs(refOut[i] - voiceOut[i]);
+
+        // The sample one of them plays past the other's end has nothing to compare with
+        if (t > std::min(refOff, voiceOff) && t <= std::max(refOff, voiceOff))
+            continue;
+
+        if (std::abs(t - refAttackEnd) <= 1)
+            worstNearEnd = std::max(worstNearEnd, (float)(d / (attackStep * peak)));
+        else if (t >= refOff - (gate ? fade + 1 : 1) && t <= refOff + 1)
+            worstNearEnd = std::max(worstNearEnd, (float)(d / (releaseStep * peak)));
+        else
+            worst = std::max(worst, d);
+    }
+
+    if (worst > tolerance || worstNearEnd > 1)
+    {
+        std::cerr << "Voice differs from reference by " << worst << ", and by "
+                  << worstNearEnd << " envelope steps near a segment end (unison=" << unison
+                  << " mode=" << filterMode << " gate=" << gate << " key=" << key
+                  << " stateful=" << stateful << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * The voice's attack and release last exactly segmentSamples, rendered a sample
+ * at a time so we see each segment end. The reference's float time drifts: within a
+ * sample of that up to 100ms, which is all compareWithReference uses, and further behind
+ * or ahead over longer segments, which is why the voice counts samples.
+ */
+static bool checkSegmentEnds()
+{
+    for (float seconds : {0.004f, 0.01f, 0.05f, 0.1f, 0.25f, 1.f})
+    {
+        for (float sr : {44100.f, 48000.f, 96000.f})
+        {
+            ReferenceVoice ref;
+            SawDemoVoice v;
+            ref.ampAttack = v.ampAttack = seconds;
+            ref.ampRelease = v.ampRelease = seconds;
+            ref.sampleRate = v.sampleRate = sr;
+            ref.start(60);
+            v.start(60);
+
+            // Samples each spends in the attack, then the release
+            int refLen[2]{0, 0}, voiceLen[2]{0, 0};
+            for (int seg = 0; seg < 2; ++seg)
+            {
+                auto inSeg = seg == 0 ? SawDemoVoice::ATTACK : SawDemoVoice::RELEASING;
+                if (seg == 1)
+                {
+                    ref.release();
+                    v.release();
+                }
+                while (ref.state == inSeg)
+                {
+                    ref.step();
+                    refLen[seg]++;
+                }
+                while (v.state == inSeg)
+                {
+                    float L{0}, R{0};
+                    v.renderBlock(&L, &R, 1);
+                    voiceLen[seg]++;
+                }
+
+                auto expected = segmentSamples(seconds, 1.0 / sr);
+                if (voiceLen[seg] != expected ||
+                    (seconds <= 0.1f && std::abs(refLen[seg] - voiceLen[seg]) > 1))
+                {
+                    std::cerr << "Segment " << seg << " of " << seconds << "s at " << sr
+                              << " lasted " << voiceLen[seg] << " samples, not " << expected
+                              << " (reference " << refLen[seg] << ")" << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * The stateful differentiator against the direct one, with the pitch bent every few
+ * blocks so the history has to be rebuilt at pitch changes as well as at phase wraps.
+ */
+static bool compareDifferentiators(int unison, int key)
+{
+    SawDemoVoice direct, stateful;
+    direct.statefulDPW = false;
+    stateful.statefulDPW = true;
+    for (auto *v : {&direct, &stateful})
+    {
+        v->unison = unison;
+        v->uniSpread = 30;
+        v->cutoff = 100;
+        v->sampleRate = 48000;
+        v->start(key);
+    }
+
+    std::vector<float> LD(64), RD(64), LS(64), RS(64);
+    float worst{0};
+    for (int blk = 0; blk < 300; ++blk)
+    {
+        if (blk % 5 == 0)
+        {
+            for (auto *v : {&direct, &stateful})
+            {
+                v->pitchBendWheel = 2.f * std::sin(blk * 0.1f);
+                v->recalcPitch();
+            }
+        }
+
+        int bs = 1 + (blk * 11) % 64;
+        for (auto *buf : {&LD, &RD, &LS, &RS})
+            std::fill(buf->begin(), buf->end(), 0.f);
+        direct.renderBlock(LD.data(), RD.data(), bs);
+        stateful.renderBlock(LS.data(), RS.data(), bs);
+
+        for (int i = 0; i < bs; ++i)
+            worst = std::max({worst, std::fabs(LD[i] - LS[i]), std::fabs(RD[i] - RS[i])});
+    }
+
+    if (worst > tolerance)
+    {
+        std::cerr << "Stateful differentiator differs from direct by " << worst
+                  << " (unison=" << unison << " key=" << key << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Render the same handful of voices with the per voice engine and the voice-parallel
+ * bank, mixed unison counts and filter modes, with some voices finishing mid block.
+ * With a filter glide we also sweep the cutoff, so both engines run their glides.
+ */
+static bool compareBankWithVoices(int nvoices, int glide, bool stateful)
+{
+    std::vector<SawDemoVoice> a(nvoices), b(nvoices);
+    for (int i = 0; i < nvoices; ++i)
+    {
+        for (auto *v : {&a[i], &b[i]})
+        {
+            v->unison = 1 + i % SawDemoVoice::max_uni;
+            v->filterMode = i % 6;
+            v->ampGate = (i % 4 == 3);
+            v->ampAttack = 0.002 * (i % 3);
+            v->ampRelease = 0.004 + 0.003 * i;
+            v->cutoff = 70 + 3 * i;
+            v->res = 0.3 + 0.05 * (i % 8);
+            v->filterGlide = glide;
+            v->statefulDPW = stateful;
+            v->sampleRate = 48000;
+            v->start(36 + 5 * i);
+        }
+    }
+
+    SawDemoVoiceBank bank;
+    std::vector<float> LA(64), RA(64), LB(64), RB(64);
+    float worst{0};
+    for (int blk = 0; blk < 100; ++blk)
+    {
+        if (blk == 20)
+        {
+            for (int i = 0; i < nvoices; i += 2)
+            {
+                a[i].release();
+                b[i].release();
+            }
+        }
+
+        if (glide > 0)
+        {
+            for (int i = 0; i < nvoices; ++i)
+            {
+                a[i].cutoff = b[i].cutoff = 70 + 3 * i + 20 * std::sin(blk * 0.3);
+                a[i].recalcFilter();
+                b[i].recalcFilter();
+            }
+        }
+
+        int bs = 1 + (blk * 13) % 64;
+        for (auto *buf : {&LA, &RA, &LB, &RB})
+            std::fill(buf->begin(), buf->end(), 0.f);
+
+        std::vector<SawDemoVoice *> playing;
+        for (int i = 0; i < nvoices; ++i)
+        {
+            if (a[i].isPlaying())
+                a[i].renderBlock(LA.data(), RA.data(), bs);
+            if (b[i].isPlaying())
+                playing.push_back(&b[i]);
+        }
+        for (size_t g = 0; g < playing.size(); g += SawDemoVoiceBank::bank_lanes)
+        {
+            int n = std::min((int)(playing.size() - g), SawDemoVoiceBank::bank_lanes);
+            bank.renderBlock(&playing[g], n, LB.data(), RB.data(), bs);
+        }
+
+        for (int i = 0; i < bs; ++i)
+            worst = std::max({worst, std::fabs(LA[i] - LB[i]), std::fabs(RA[i] - RB[i])});
+
+        for (int i = 0; i < nvoices; ++i)
+        {
+            if (a[i].state != b[i].state)
+            {
+                std::cerr << "Voice bank state differs for voice " << i << " at block " << blk
+                          << std::endl;
+                return false;
+            }
+        }
+    }
+
+    if (worst > bank_tolerance)
+    {
+        std::cerr << "Voice bank differs from per voice rendering by " << worst
+                  << " (voices=" << nvoices << " glide=" << glide << " stateful=" << stateful
+                  << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * The wavetables should be the DPW's -1 to 1 ramp away from the edges, and a wavetable
+ * voice should come out at the same level as a DPW one.
+ */
+static bool checkWavetable()
+{
+    const auto &wt = SawWavetable::instance();
+    for (int t = 0; t <= 3; ++t)
+    {
+        for (double p : {0.1, 0.25, 0.5, 0.75, 0.9})
+        {
+            auto fx = SawWavetable::toFixed(p);
+            for (auto v : {SawWavetable::readLinear(wt.table(t), fx),
+                           SawWavetable::readCubic(wt.table(t), fx)})
+            {
+                if (std::fabs(v - (2 * p - 1)) > 0.01)
+                {
+                    std::cerr << "Wavetable " << t << " at phase " << p << " is " << v
+                              << " not " << 2 * p - 1 << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+
+    for (int engine : {SawDemoVoice::OSC_WAVETABLE_LINEAR, SawDemoVoice::OSC_WAVETABLE_CUBIC})
+    {
+        for (int key : {36, 60, 84})
+        {
+            SawDemoVoice dpw, table;
+            table.oscEngine = engine;
+            for (auto *v : {&dpw, &table})
+            {
+                v->wavetable = &wt;
+                v->cutoff = 127;
+                v->sampleRate = 48000;
+                v->start(key);
+            }
+
+            std::vector<float> LD(4800, 0.f), RD(4800, 0.f), LT(4800, 0.f), RT(4800, 0.f);
+            dpw.renderBlock(LD.data(), RD.data(), 4800);
+            table.renderBlock(LT.data(), RT.data(), 4800);
+
+            double pd{0}, pt{0};
+            for (int i = 0; i < 4800; ++i)
+            {
+                pd += LD[i] * LD[i] + RD[i] * RD[i];
+                pt += LT[i] * LT[i] + RT[i] * RT[i];
+            }
+            auto ratio = std::sqrt(pt / pd);
+            if (std::fabs(ratio - 1) > 0.02)
+            {
+                std::cerr << "Wavetable voice level is " << ratio << " of DPW (engine=" << engine
+                          << " key=" << key << ")" << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * A cutoff change on a gliding voice should leave the filter alone until the next
+ * control tick, then land exactly on the new coefficients filterGlide samples later.
+ * Ticks come every filterGlide samples from the voice's start.
+ */
+static bool checkFilterGlide()
+{
+    SawDemoVoice v, fresh;
+    for (auto *p : {&v, &fresh})
+    {
+        p->filterGlide = 16;
+        p->sampleRate = 48000;
+    }
+    v.cutoff = 60;
+    fresh.cutoff = 90;
+    v.start(48);
+    fresh.start(48);
+
+    std::vector<float> L(64, 0.f), R(64, 0.f);
+    v.renderBlock(L.data(), R.data(), 10);
+
+    auto before = v.filter.a1;
+    v.cutoff = 90;
+    v.recalcFilter();
+    v.renderBlock(L.data(), R.data(), 6);
+    if (v.filter.a1 != before)
+    {
+        std::cerr << "Filter coefficients changed before the control tick" << std::endl;
+        return false;
+    }
+
+    v.renderBlock(L.data(), R.data(), 8);
+    auto mid = v.filter.a1;
+    v.renderBlock(L.data(), R.data(), 8);
+    const auto &f = v.filter, &t = fresh.filter;
+    if (mid == before || mid == t.a1 || f.a1 != t.a1 || f.a2 != t.a2 || f.a3 != t.a3 ||
+        f.ak != t.ak || f.k != t.k)
+    {
+        std::cerr << "Filter glide did not land on the new coefficients after 16 samples"
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * A voice starting after a mono cutoff mod, but before the engine has recomputed the
+ * shared filter, must not copy the stale coefficients. It should start on the same
+ * filter as one which never shared at all, glide or not.
+ */
+static bool checkStaleMonoFilter()
+{
+    SawDemoVoice::MonoModulation mono;
+    mono.sampleRate = 48000;
+    mono.recalcFilter();
+    mono.cutoffMod = 24;
+
+    SawDemoVoice v, alone;
+    for (auto *p : {&v, &alone})
+    {
+        p->filterGlide = 16;
+        p->sampleRate = 48000;
+    }
+    v.monoMod = &mono;
+    alone.cutoffMod = 24;
+    v.start(60);
+    alone.start(60);
+
+    const auto &f = v.filter, &t = alone.filter;
+    if (f.a1 != t.a1 || f.a2 != t.a2 || f.a3 != t.a3 || f.ak != t.ak || f.k != t.k)
+    {
+        std::cerr << "A voice started on a stale mono modulation filter" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * An exponential envelope should start and finish its segments on the same samples as a
+ * linear one, but get most of the way there early: louder through the first part of the
+ * attack and quieter through the second half of the release.
+ */
+static bool checkExponentialEnvelope()
+{
+    SawDemoVoice lin, ex;
+    for (auto *p : {&lin, &ex})
+    {
+        p->ampAttack = 0.004;
+        p->ampRelease = 0.01;
+        p->sampleRate = 48000;
+        p->start(60);
+    }
+    ex.ampCurve = SawDemoVoice::AEG_EXPONENTIAL;
+
+    // Energy of each voice in the first quarter of the attack, then the second half of
+    // the release, and how long each lasts after its release
+    double linE[2]{0, 0}, exE[2]{0, 0};
+    int linLen{0}, exLen{0};
+    auto run = [](SawDemoVoice &v, double *E, int &len) {
+        for (int s = 0; s < 48; ++s)
+        {
+            float L{0}, R{0};
+            v.renderBlock(&L, &R, 1);
+            E[0] += L * L + R * R;
+        }
+        std::vector<float> L(200, 0.f), R(200, 0.f);
+        v.renderBlock(L.data(), R.data(), 200 - 48);
+        v.release();
+        for (len = 0; v.isPlaying(); ++len)
+        {
+            float L{0}, R{0};
+            v.renderBlock(&L, &R, 1);
+            if (len >= 240)
+                E[1] += L * L + R * R;
+        }
+    };
+    run(lin, linE, linLen);
+    run(ex, exE, exLen);
+
+    if (linLen != exLen || linLen != 480)
+    {
+        std::cerr << "Exponential release lasted " << exLen << " samples, linear " << linLen
+                  << std::endl;
+        return false;
+    }
+    if (exE[0] < 2 * linE[0] || exE[1] * 20 > linE[1])
+    {
+        std::cerr << "Exponential envelope has the wrong shape: attack " << exE[0] << " vs "
+                  << linE[0] << ", release tail " << exE[1] << " vs " << linE[1] << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * A voice whose VCA goes to zero as it is released should finish once the silence
+ * detector has heard silence_hold quiet samples and the filter has rung out, on its own
+ * and in a bank, rather than run out its whole release. One with its VCA up should run
+ * the release to the end.
+ */
+static bool checkSilentRelease()
+{
+    for (int useBank = 0; useBank < 2; ++useBank)
+    {
+        for (float vca : {0.f, 1.f})
+        {
+            SawDemoVoice v;
+            v.ampAttack = 0.001;
+            v.ampRelease = 0.5;
+            v.sampleRate = 48000;
+            v.start(60);
+
+            SawDemoVoiceBank bank;
+            auto *vp = &v;
+            std::vector<float> L(64, 0.f), R(64, 0.f);
+            auto render = [&]() {
+                if (useBank)
+                    bank.renderBlock(&vp, 1, L.data(), R.data(), 64);
+                else
+                    v.renderBlock(L.data(), R.data(), 64);
+            };
+
+            for (int blk = 0; blk < 10; ++blk)
+                render();
+            v.preFilterVCA = vca;
+            v.release();
+
+            int blocks{0};
+            for (; v.isPlaying() && blocks < 1000; ++blocks)
+                render();
+
+            auto quick = SawDemoVoice::silence_hold / 64;
+            if (vca > 0 ? blocks != 375 : (blocks < quick || blocks > 20))
+            {
+                std::cerr << "Release at VCA " << vca << " took " << blocks
+                          << " blocks (bank=" << useBank << ")" << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * The oversampling decimators should pass the audio band flat and keep what is above the
+ * host's Nyquist from folding back, and cutting the input into uneven blocks shouldn't
+ * change a thing. Gains are measured on a sine at the host rate of 48k.
+ */
+static double decimatedGain(int factor, double hz, int block)
+{
+    static constexpr int settle = 1024, total = settle + 4800; // a whole number of cycles
+    StereoDecimator dec;
+    dec.setup(factor, 512);
+
+    std::vector<float> L(512 * factor), R(512 * factor), oL(512), oR(512);
+    double energy{0};
+    long in{0};
+    for (int done = 0; done < total;)
+    {
+        auto n = std::min(block, total - done);
+        for (int i = 0; i < n * factor; ++i, ++in)
+            L[i] = R[i] = std::sin(2.0 * 3.14159265358979323846 * hz * in / (48000.0 * factor));
+        dec.process(L.data(), R.data(), oL.data(), oR.data(), n);
+        for (int i = 0; i < n; ++i)
+            if (done + i >= settle)
+                energy += oL[i] * oL[i] + oR[i] * oR[i];
+        done += n;
+    }
+    return std::sqrt(energy / (total - settle)); // a unit sine is 1 here, over two channels
+}
+
+// How far a decimated 1kHz sine is from the input delayed by 'delay' output samples
+static double delayError(int factor, double delay)
+{
+    const double w = 2.0 * 3.14159265358979323846 * 1000.0 / 48000.0;
+    StereoDecimator dec;
+    dec.setup(factor, 512);
+
+    std::vector<float> L(512 * factor), R(512 * factor), oL(512), oR(512);
+    for (int i = 0; i < 512 * factor; ++i)
+        L[i] = R[i] = std::sin(w * i / factor);
+    dec.process(L.data(), R.data(), oL.data(), oR.data(), 512);
+
+    double worst{0};
+    for (int i = 64; i < 512; ++i)
+        worst = std::max(worst, std::fabs(oL[i] - std::sin(w * (i - delay))));
+    return worst;
+}
+
+static bool checkDecimator()
+{
+    for (int factor : {2, 4})
+    {
+        for (double hz : {100.0, 1000.0, 10000.0, 19000.0})
+        {
+            auto g = decimatedGain(factor, hz, 512);
+            if (std::fabs(20 * std::log10(g)) > 0.01)
+            {
+                std::cerr << factor << "x decimator gain at " << hz << "Hz is " << g << std::endl;
+                return false;
+            }
+        }
+        for (double hz : {29000.0, 40000.0, factor * 24000.0 - 5000})
+        {
+            auto g = decimatedGain(factor, hz, 512);
+            if (20 * std::log10(g) > -75)
+            {
+                std::cerr << factor << "x decimator lets " << hz << "Hz through at " << g
+                          << std::endl;
+                return false;
+            }
+        }
+
+        // The delay we report as latency is the real one, and off by half a sample isn't
+        StereoDecimator dec;
+        dec.setup(factor, 512);
+        auto d = dec.delay();
+        if (delayError(factor, d) > 1e-3 || delayError(factor, d + 0.5) < 1e-2)
+        {
+            std::cerr << factor << "x decimator does not delay by " << d << " samples"
+                      << std::endl;
+            return false;
+        }
+
+        if (decimatedGain(factor, 3000, 512) != decimatedGain(factor, 3000, 37))
+        {
+            std::cerr << factor << "x decimator depends on the block size" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// The fast pitch and tan approximations should stay inside the error their comments claim
+static bool checkFastMath()
+{
+    using namespace sst::clap_saw_demo::dspmath;
+    double worstPow{0}, worstTan{0};
+    for (double st = -240; st <= 240; st += 0.0137)
+    {
+        auto exact = std::pow(2.0, st / 12.0);
+        worstPow = std::max(worstPow, std::fabs(fastPow2(st / 12.0) / exact - 1));
+    }
+    for (double x = 1e-4; x <= 1.4; x += 1e-4)
+        worstTan = std::max(worstTan, std::fabs(fastTan(x) / std::tan(x) - 1));
+
+    if (worstPow > 1e-12 || worstTan > 3e-5)
+    {
+        std::cerr << "Fast math error too large: pow2 " << worstPow << " tan " << worstTan
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    std::cout << "Starting voice test..." << std::endl;
+
+    bool ok{true};
+    for (int uni = 1; uni <= SawDemoVoice::max_uni; ++uni)
+        for (int fm = SawDemoVoice::StereoSimperSVF::LP; fm <= SawDemoVoice::StereoSimperSVF::ALL;
+             ++fm)
+            for (int gate = 0; gate < 2; ++gate)
+                for (int key : {24, 60, 96})
+                    for (int stateful = 0; stateful < 2; ++stateful)
+                        ok = ok && compareWithReference(uni, fm, gate, key, stateful);
+    ok = ok && checkSegmentEnds();
+
+    for (int uni = 1; uni <= SawDemoVoice::max_uni; ++uni)
+        for (int key : {12, 60, 120})
+            ok = ok && compareDifferentiators(uni, key);
+
+    for (int nv : {1, 3, 4, 8, 13})
+        for (int glide : {0, 8, 32})
+            for (bool stateful : {false, true})
+                ok = ok && compareBankWithVoices(nv, glide, stateful);
+
+    ok = ok && checkFilterGlide();
+    ok = ok && checkStaleMonoFilter();
+    ok = ok && checkExponentialEnvelope();
+    ok = ok && checkSilentRelease();
+
+    ok = ok && checkWavetable();
+    ok = ok && checkDecimator();
+    ok = ok && checkFastMath();
+
+    if (!ok)
+    {
+        std::cerr << "Voice test failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Voice test completed successfully!" << std::endl;
+    return 0;
+}